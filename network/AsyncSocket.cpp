@@ -36,7 +36,7 @@ AsyncSocket::AsyncSocket(SOCKET sock, EventThread * thread, size_t bufSize, size
     int nSendBuf = sockSize;
     SockUtil::setSendBuf(sock, nSendBuf);
     //SockUtil::setRecvLowWaterMark(sock, 16);
-    _thread->addEvent(sock, 0, std::bind(&AsyncSocket::onEvent, this, std::placeholders::_1, std::placeholders::_2));
+    _thread->addEvent(sock, 0, [this](int fd, int events) { onEvent(fd, events); });
 }
 
 AsyncSocket::~AsyncSocket() {
@@ -1,4 +1,5 @@
 #include "Buffer.h"
+#include <memory>
 
 #include "platform.h"
 
@@ -8,11 +9,38 @@ const char Buffer::kCRLF[] = "\r\n";
 
 const size_t Buffer::kCheapPrepend;
 const size_t Buffer::kInitialSize;
+const size_t Buffer::kMinReadSize;
+const size_t Buffer::kMaxReadSize;
+
+// 溢出区每线程一份，代替每次调用在栈上放64K
+static char* overflowBuffer()
+{
+	static thread_local std::unique_ptr<char[]> buf;
+	if (!buf)
+	{
+		buf.reset(new char[Buffer::kMaxReadSize]);
+	}
+	return buf.get();
+}
 
 int32_t Buffer::readFd(int fd, int* savedErrno)
 {
-	// saved an ioctl()/FIONREAD call to tell how much to read
-	char extrabuf[65536];
+	char* extrabuf = overflowBuffer();
+	size_t want = readSize_;
+	bool exact = false;
+#ifndef WIN32
+	if (useFionread_)
+	{
+		int avail = 0;
+		if (::ioctl(fd, FIONREAD, &avail) == 0 && avail > 0)
+		{
+			want = std::min((size_t)avail, kMaxReadSize);
+			exact = true;
+		}
+	}
+#endif
+	shrinkIfIdle();
+	ensureWritableBytes(want);
     const size_t writable = writableBytes();
 #ifndef WIN32
 	struct iovec vec[2];
@@ -20,13 +48,12 @@ int32_t Buffer::readFd(int fd, int* savedErrno)
 	vec[0].iov_base = begin() + writerIndex_;
 	vec[0].iov_len = writable;
 	vec[1].iov_base = extrabuf;
-	vec[1].iov_len = sizeof extrabuf;
-	// when there is enough space in this buffer, don't read into extrabuf.
-	// when extrabuf is used, we read 128k-1 bytes at most.
-	const int iovcnt = (writable < sizeof extrabuf) ? 2 : 1;
+	vec[1].iov_len = kMaxReadSize;
+	// 已知可读字节数时不用溢出区；否则可写空间不足kMaxReadSize时用溢出区兜底，一次最多读writable+64k
+	const int iovcnt = (!exact && writable < kMaxReadSize) ? 2 : 1;
 	const ssize_t n = readv(fd, vec, iovcnt);
 #else
-    const int32_t n = ::recv(fd, extrabuf, sizeof(extrabuf), 0);
+    const int32_t n = ::recv(fd, extrabuf, kMaxReadSize, 0);
 #endif
 	if (n <= 0)
 	{
@@ -35,6 +62,7 @@ int32_t Buffer::readFd(int fd, int* savedErrno)
 #else
 		*savedErrno = errno;
 #endif
+		return n;
 	}
 	else if ((size_t)n <= writable)
 	{
@@ -56,9 +84,24 @@ int32_t Buffer::readFd(int fd, int* savedErrno)
         append(extrabuf, n - writable);
 #endif
 	}
-	// if (n == writable + sizeof extrabuf)
-	// {
-	//   goto line_30;
-	// }
+
+	// 调整下次的读大小：读到预期大小则翻倍，连续4次不到1/4则减半
+	if ((size_t)n >= readSize_)
+	{
+		readSize_ = std::min(readSize_ * 2, kMaxReadSize);
+		smallReads_ = 0;
+	}
+	else if ((size_t)n < readSize_ / 4)
+	{
+		if (++smallReads_ >= 4)
+		{
+			readSize_ = std::max(readSize_ / 2, kMinReadSize);
+			smallReads_ = 0;
+		}
+	}
+	else
+	{
+		smallReads_ = 0;
+	}
 	return n;
 }
@@ -5,6 +5,7 @@
 #include <string>
 #include <string.h>
 #include "NetEndian.h"
+#include "BufferPool.h"
 
 #include "platform.h"
 
@@ -27,6 +28,9 @@ class Buffer
 public:
 	static const size_t kCheapPrepend = 16;
 	static const size_t kInitialSize = 4096-kCheapPrepend;
+	// readFd自适应读大小的范围，上限也是线程共享溢出区的大小
+	static const size_t kMinReadSize = 512;
+	static const size_t kMaxReadSize = 65536;
 
 	explicit Buffer(size_t initialSize = kInitialSize)
 		: buffer_(kCheapPrepend + initialSize),
@@ -420,9 +424,25 @@ public:
 	/// Read data directly into buffer.
 	///
 	/// It may implement with readv(2)
+	/// 每次预留readSize()的可写空间，读满则翻倍，连续几次读得很少则减半；
+	/// 超出部分先读进线程共享的溢出区再追加
 	/// @return result of read(2), @c errno is saved
 	int32_t readFd(int fd, int* savedErrno);
 
+	// 读之前用FIONREAD查询内核中可读字节数，按实际大小预留空间，省掉溢出区拷贝，多一次系统调用
+	void setReadHintFionread(bool on) { useFionread_ = on; }
+	size_t readSize() const { return readSize_; }
+
+	// 没有可读数据且容量远大于当前读大小时释放存储，空闲连接不长期占着大块内存
+	void shrinkIfIdle()
+	{
+		if (readableBytes() == 0 && buffer_.size() > kCheapPrepend + 2 * std::max(readSize_, kInitialSize))
+		{
+			decltype(buffer_)(kCheapPrepend + readSize_).swap(buffer_);
+			retrieveAll();
+		}
+	}
+
 private:
 
 	char* begin()
@@ -461,9 +481,13 @@ private:
 	}
 
 private:
-	std::vector<char>           buffer_;
+	// 存储从当前线程的BufferPool分配
+	std::vector<char, PoolAllocator<char>> buffer_;
 	size_t                      readerIndex_;
 	size_t                      writerIndex_;
+	size_t                      readSize_ = kInitialSize;
+	uint8_t                     smallReads_ = 0;
+	bool                        useFionread_ = false;
 
 	static const char           kCRLF[];
 };
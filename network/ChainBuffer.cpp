@@ -0,0 +1,433 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "ChainBuffer.h"
+#include <algorithm>
+#include <new>
+#include <string.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#include <errno.h>
+#endif
+
+using namespace DLNetwork;
+
+namespace {
+// 一次readFd最多读这么多，与Buffer的extrabuf相当
+const size_t kReadSize = 65536;
+const int kMaxReadIov = 17;
+const char kEmpty[1] = { 0 };
+}
+
+const size_t ChainBuffer::kDefaultSegmentSize;
+
+ChainBuffer::Block* ChainBuffer::newBlock(size_t cap) {
+	void* p = BufferPool::allocBlock(sizeof(Block) + cap);
+	Block* b = new (p) Block;
+	b->refs.store(1, std::memory_order_relaxed);
+	b->cap = cap;
+	return b;
+}
+
+void ChainBuffer::unref(Block* b) {
+	if (b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		size_t cap = b->cap;
+		b->~Block();
+		BufferPool::freeBlock(b, sizeof(Block) + cap);
+	}
+}
+
+ChainBuffer::ChainBuffer(size_t segmentSize)
+	: _segmentSize(segmentSize ? segmentSize : kDefaultSegmentSize) {
+}
+
+ChainBuffer::~ChainBuffer() {
+	retrieveAll();
+}
+
+ChainBuffer::ChainBuffer(const ChainBuffer& other)
+	: _segs(other._segs), _size(other._size), _segmentSize(other._segmentSize) {
+	for (auto& s : _segs) {
+		ref(s.block);
+	}
+}
+
+ChainBuffer& ChainBuffer::operator=(const ChainBuffer& other) {
+	if (this != &other) {
+		ChainBuffer tmp(other);
+		swap(tmp);
+	}
+	return *this;
+}
+
+ChainBuffer::ChainBuffer(ChainBuffer&& other) noexcept
+	: _segs(std::move(other._segs)), _size(other._size), _segmentSize(other._segmentSize) {
+	other._segs.clear();
+	other._size = 0;
+}
+
+ChainBuffer& ChainBuffer::operator=(ChainBuffer&& other) noexcept {
+	if (this != &other) {
+		retrieveAll();
+		swap(other);
+	}
+	return *this;
+}
+
+void ChainBuffer::swap(ChainBuffer& rhs) noexcept {
+	_segs.swap(rhs._segs);
+	std::swap(_size, rhs._size);
+	std::swap(_segmentSize, rhs._segmentSize);
+}
+
+const char* ChainBuffer::segment(size_t i, size_t* len) const {
+	const Seg& s = _segs[i];
+	*len = s.len();
+	return s.ptr();
+}
+
+bool ChainBuffer::tailWritable() const {
+	if (_segs.empty()) {
+		return false;
+	}
+	const Seg& t = _segs.back();
+	return t.end < t.block->cap && t.block->refs.load(std::memory_order_acquire) == 1;
+}
+
+const char* ChainBuffer::pullup(size_t n) {
+	if (_segs.empty()) {
+		return kEmpty;
+	}
+	n = std::min(n, _size);
+	if (_segs.front().len() >= n) {
+		return _segs.front().ptr();
+	}
+	// 把开头n字节拷到一个新段里，原来的段用完即释放
+	Block* b = newBlock(std::max(n, _segmentSize));
+	size_t copied = 0;
+	while (copied < n) {
+		Seg& s = _segs.front();
+		size_t take = std::min(s.len(), n - copied);
+		memcpy(b->data() + copied, s.ptr(), take);
+		copied += take;
+		if (take == s.len()) {
+			unref(s.block);
+			_segs.pop_front();
+		}
+		else {
+			s.begin += take;
+		}
+	}
+	_segs.push_front(Seg{ b, 0, n });
+	return b->data();
+}
+
+ptrdiff_t ChainBuffer::find(const char* pattern, size_t plen) const {
+	// 模式很短(CRLF/EOL)，跨段边界的匹配逐字节比较即可
+	size_t base = 0;
+	size_t matched = 0;
+	for (const Seg& s : _segs) {
+		const char* p = s.ptr();
+		size_t len = s.len();
+		for (size_t i = 0; i < len; ++i) {
+			if (p[i] == pattern[matched]) {
+				if (++matched == plen) {
+					return (ptrdiff_t)(base + i + 1 - plen);
+				}
+			}
+			else if (matched) {
+				// 模式内没有重复前缀，回退到当前字符重新匹配
+				matched = (p[i] == pattern[0]) ? 1 : 0;
+			}
+		}
+		base += len;
+	}
+	return -1;
+}
+
+const char* ChainBuffer::findCRLF() {
+	ptrdiff_t off = find("\r\n", 2);
+	if (off < 0) {
+		return nullptr;
+	}
+	return pullup(off + 2) + off;
+}
+
+const char* ChainBuffer::findEOL() {
+	ptrdiff_t off = find("\n", 1);
+	if (off < 0) {
+		return nullptr;
+	}
+	return pullup(off + 1) + off;
+}
+
+bool ChainBuffer::retrieve(size_t len) {
+	if (len > _size) {
+		return false;
+	}
+	_size -= len;
+	while (len) {
+		Seg& s = _segs.front();
+		if (len < s.len()) {
+			s.begin += len;
+			break;
+		}
+		len -= s.len();
+		unref(s.block);
+		_segs.pop_front();
+	}
+	return true;
+}
+
+bool ChainBuffer::retrieveUntil(const char* end) {
+	if (_segs.empty()) {
+		return end == kEmpty;
+	}
+	const Seg& f = _segs.front();
+	if (end < f.ptr() || end > f.ptr() + f.len()) {
+		return false;
+	}
+	return retrieve(end - f.ptr());
+}
+
+void ChainBuffer::retrieveAll() {
+	for (auto& s : _segs) {
+		unref(s.block);
+	}
+	_segs.clear();
+	_size = 0;
+}
+
+std::string ChainBuffer::retrieveAsString(size_t len) {
+	len = std::min(len, _size);
+	std::string result;
+	result.reserve(len);
+	size_t left = len;
+	for (const Seg& s : _segs) {
+		if (!left) {
+			break;
+		}
+		size_t take = std::min(left, s.len());
+		result.append(s.ptr(), take);
+		left -= take;
+	}
+	retrieve(len);
+	return result;
+}
+
+std::string ChainBuffer::toStringPiece() const {
+	std::string result;
+	result.reserve(_size);
+	for (const Seg& s : _segs) {
+		result.append(s.ptr(), s.len());
+	}
+	return result;
+}
+
+size_t ChainBuffer::copyOut(void* dst, size_t len) const {
+	len = std::min(len, _size);
+	size_t copied = 0;
+	for (const Seg& s : _segs) {
+		if (copied == len) {
+			break;
+		}
+		size_t take = std::min(len - copied, s.len());
+		memcpy(static_cast<char*>(dst) + copied, s.ptr(), take);
+		copied += take;
+	}
+	return copied;
+}
+
+void ChainBuffer::append(const char* data, size_t len) {
+	while (len) {
+		if (!tailWritable()) {
+			_segs.push_back(Seg{ newBlock(_segmentSize), 0, 0 });
+		}
+		Seg& t = _segs.back();
+		size_t n = std::min(len, t.block->cap - t.end);
+		memcpy(t.block->data() + t.end, data, n);
+		t.end += n;
+		_size += n;
+		data += n;
+		len -= n;
+	}
+}
+
+void ChainBuffer::prepend(const void* data, size_t len) {
+	if (!len) {
+		return;
+	}
+	if (!_segs.empty()) {
+		Seg& f = _segs.front();
+		if (f.begin >= len && f.block->refs.load(std::memory_order_acquire) == 1) {
+			f.begin -= len;
+			memcpy(f.ptr(), data, len);
+			_size += len;
+			return;
+		}
+	}
+	// 数据放在新段末尾，给后续prepend留空间；末段写满后append不会写进这里
+	Block* b = newBlock(std::max(len, _segmentSize));
+	memcpy(b->data() + b->cap - len, data, len);
+	_segs.push_front(Seg{ b, b->cap - len, b->cap });
+	_size += len;
+}
+
+void ChainBuffer::splice(ChainBuffer& other) {
+	if (&other == this) {
+		return;
+	}
+	for (auto& s : other._segs) {
+		_segs.push_back(s);
+	}
+	_size += other._size;
+	other._segs.clear();
+	other._size = 0;
+}
+
+void ChainBuffer::splice(ChainBuffer& other, size_t len) {
+	if (&other == this) {
+		return;
+	}
+	len = std::min(len, other._size);
+	other._size -= len;
+	_size += len;
+	while (len) {
+		Seg& s = other._segs.front();
+		if (len < s.len()) {
+			// 拆分段：两边共享同一块存储
+			ref(s.block);
+			_segs.push_back(Seg{ s.block, s.begin, s.begin + len });
+			s.begin += len;
+			break;
+		}
+		len -= s.len();
+		_segs.push_back(s);
+		other._segs.pop_front();
+	}
+}
+
+ChainBuffer ChainBuffer::slice(size_t offset, size_t len) const {
+	ChainBuffer result(_segmentSize);
+	if (offset >= _size) {
+		return result;
+	}
+	len = std::min(len, _size - offset);
+	for (const Seg& s : _segs) {
+		if (!len) {
+			break;
+		}
+		if (offset >= s.len()) {
+			offset -= s.len();
+			continue;
+		}
+		size_t take = std::min(len, s.len() - offset);
+		ref(s.block);
+		result._segs.push_back(Seg{ s.block, s.begin + offset, s.begin + offset + take });
+		result._size += take;
+		len -= take;
+		offset = 0;
+	}
+	return result;
+}
+
+#ifndef WIN32
+int ChainBuffer::fillIovec(struct iovec* iov, int maxIov, size_t maxBytes) const {
+	int cnt = 0;
+	for (const Seg& s : _segs) {
+		if (cnt >= maxIov || !maxBytes) {
+			break;
+		}
+		size_t take = std::min(s.len(), maxBytes);
+		iov[cnt].iov_base = s.ptr();
+		iov[cnt].iov_len = take;
+		maxBytes -= take;
+		++cnt;
+	}
+	return cnt;
+}
+#endif
+
+int32_t ChainBuffer::readFd(int fd, int* savedErrno) {
+#ifndef WIN32
+	// 先填末段剩余空间，不够kReadSize再补新段，读完把没用上的段还回去
+	struct iovec vec[kMaxReadIov];
+	Block* fresh[kMaxReadIov];
+	int cnt = 0;
+	int nfresh = 0;
+	size_t tailSpace = 0;
+	if (tailWritable()) {
+		Seg& t = _segs.back();
+		tailSpace = t.block->cap - t.end;
+		vec[cnt].iov_base = t.block->data() + t.end;
+		vec[cnt].iov_len = tailSpace;
+		++cnt;
+	}
+	size_t space = tailSpace;
+	while (space < kReadSize && cnt < kMaxReadIov) {
+		Block* b = newBlock(_segmentSize);
+		fresh[nfresh++] = b;
+		vec[cnt].iov_base = b->data();
+		vec[cnt].iov_len = b->cap;
+		++cnt;
+		space += b->cap;
+	}
+	const ssize_t n = readv(fd, vec, cnt);
+	if (n <= 0) {
+		*savedErrno = errno;
+		for (int i = 0; i < nfresh; ++i) {
+			unref(fresh[i]);
+		}
+		return (int32_t)n;
+	}
+	size_t left = (size_t)n;
+	_size += left;
+	if (tailSpace) {
+		size_t take = std::min(left, tailSpace);
+		_segs.back().end += take;
+		left -= take;
+	}
+	for (int i = 0; i < nfresh; ++i) {
+		if (left) {
+			size_t take = std::min(left, fresh[i]->cap);
+			_segs.push_back(Seg{ fresh[i], 0, take });
+			left -= take;
+		}
+		else {
+			unref(fresh[i]);
+		}
+	}
+	return (int32_t)n;
+#else
+	Block* b = newBlock(std::max(_segmentSize, kReadSize));
+	const int32_t n = ::recv(fd, b->data(), (int)b->cap, 0);
+	if (n <= 0) {
+		*savedErrno = ::WSAGetLastError();
+		unref(b);
+		return n;
+	}
+	_segs.push_back(Seg{ b, 0, (size_t)n });
+	_size += n;
+	return n;
+#endif
+}
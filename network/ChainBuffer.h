@@ -0,0 +1,151 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include "platform.h"
+#include "BufferPool.h"
+#include "NetEndian.h"
+
+#ifndef WIN32
+struct iovec;
+#endif
+
+namespace DLNetwork
+{
+
+/// 由固定大小的段组成的链式缓冲区，接口与Buffer一致(peek/retrieve/append/findCRLF/readFd)
+/// 追加和读取都不搬移已有数据；段的存储带引用计数，slice/splice/拷贝只共享段不拷贝数据，
+/// 被共享的段只读，追加时另起新段。段的内存来自当前线程的BufferPool
+///
+/// peek()返回的指针需要数据连续，多段时会把数据拷到一个段里(pullup)，
+/// 只需要开头若干字节连续时用pullup(n)；逐段处理可用segment()或fillIovec()
+class ChainBuffer
+{
+public:
+	static const size_t kDefaultSegmentSize = 4096;
+
+	explicit ChainBuffer(size_t segmentSize = kDefaultSegmentSize);
+	~ChainBuffer();
+	// 拷贝共享所有段，不拷贝数据
+	ChainBuffer(const ChainBuffer& other);
+	ChainBuffer& operator=(const ChainBuffer& other);
+	ChainBuffer(ChainBuffer&& other) noexcept;
+	ChainBuffer& operator=(ChainBuffer&& other) noexcept;
+	void swap(ChainBuffer& rhs) noexcept;
+
+	size_t readableBytes() const { return _size; }
+	bool empty() const { return _size == 0; }
+	size_t segmentCount() const { return _segs.size(); }
+	// 第i段的数据和长度
+	const char* segment(size_t i, size_t* len) const;
+
+	// 保证开头n字节(不超过readableBytes)连续并返回其地址
+	const char* pullup(size_t n);
+	// 全部可读数据连续后的地址，空时返回指向空串的指针
+	const char* peek() { return pullup(_size); }
+
+	// 跨段查找，找到时把找到的位置之前的数据pullup，返回指向它的指针，没有时返回nullptr
+	const char* findCRLF();
+	const char* findEOL();
+
+	bool retrieve(size_t len);
+	// end必须是peek/pullup/findCRLF等返回的第一段内的地址
+	bool retrieveUntil(const char* end);
+	void retrieveAll();
+	std::string retrieveAsString(size_t len);
+	std::string retrieveAllAsString() { return retrieveAsString(_size); }
+	std::string toStringPiece() const;
+
+	// 把开头len字节拷到dst，不改变缓冲区，返回实际拷贝的字节数
+	size_t copyOut(void* dst, size_t len) const;
+
+	void append(const char* data, size_t len);
+	void append(const std::string& str) { append(str.data(), str.size()); }
+
+	// 网络字节序整数，同Buffer；数据不足时peek返回-1
+	void appendInt64(int64_t x) { int64_t be64 = hostToNetwork64(x); append((const char*)&be64, sizeof be64); }
+	void appendInt32(int32_t x) { int32_t be32 = hostToNetwork32(x); append((const char*)&be32, sizeof be32); }
+	void appendInt16(int16_t x) { int16_t be16 = hostToNetwork16(x); append((const char*)&be16, sizeof be16); }
+	void appendInt8(int8_t x) { append((const char*)&x, sizeof x); }
+	int64_t peekInt64() const { int64_t be64 = 0; return copyOut(&be64, sizeof be64) == sizeof be64 ? networkToHost64(be64) : -1; }
+	int32_t peekInt32() const { int32_t be32 = 0; return copyOut(&be32, sizeof be32) == sizeof be32 ? networkToHost32(be32) : -1; }
+	int16_t peekInt16() const { int16_t be16 = 0; return copyOut(&be16, sizeof be16) == sizeof be16 ? networkToHost16(be16) : -1; }
+	int8_t peekInt8() const { int8_t x = 0; return copyOut(&x, sizeof x) == sizeof x ? x : -1; }
+	int64_t readInt64() { int64_t r = peekInt64(); retrieve(sizeof r); return r; }
+	int32_t readInt32() { int32_t r = peekInt32(); retrieve(sizeof r); return r; }
+	int16_t readInt16() { int16_t r = peekInt16(); retrieve(sizeof r); return r; }
+	int8_t readInt8() { int8_t r = peekInt8(); retrieve(sizeof r); return r; }
+	void prependInt64(int64_t x) { int64_t be64 = hostToNetwork64(x); prepend(&be64, sizeof be64); }
+	void prependInt32(int32_t x) { int32_t be32 = hostToNetwork32(x); prepend(&be32, sizeof be32); }
+	void prependInt16(int16_t x) { int16_t be16 = hostToNetwork16(x); prepend(&be16, sizeof be16); }
+	void prependInt8(int8_t x) { prepend(&x, sizeof x); }
+	// 在开头插入，第一段前面有空间时不新建段
+	void prepend(const void* data, size_t len);
+
+	// 把other的全部数据/开头len字节移到本缓冲区末尾，只移动或共享段
+	void splice(ChainBuffer& other);
+	void splice(ChainBuffer& other, size_t len);
+	// [offset, offset+len)的只读视图，与本缓冲区共享段
+	ChainBuffer slice(size_t offset, size_t len) const;
+
+#ifndef WIN32
+	// 导出可读数据给writev，最多maxIov段、maxBytes字节，返回段数
+	int fillIovec(struct iovec* iov, int maxIov, size_t maxBytes = (size_t)-1) const;
+#endif
+	// 直接读进段中(readv)，返回值同read(2)，出错时errno保存在savedErrno
+	int32_t readFd(int fd, int* savedErrno);
+
+private:
+	struct Block {
+		std::atomic<int> refs;
+		size_t cap;
+		char* data() { return reinterpret_cast<char*>(this + 1); }
+	};
+	struct Seg {
+		Block* block;
+		size_t begin;
+		size_t end;
+		char* ptr() const { return block->data() + begin; }
+		size_t len() const { return end - begin; }
+	};
+
+	static Block* newBlock(size_t cap);
+	static void ref(Block* b) { b->refs.fetch_add(1, std::memory_order_relaxed); }
+	static void unref(Block* b);
+	// 末段独占且还有空间时可以直接追加
+	bool tailWritable() const;
+	// 找不到时返回-1
+	ptrdiff_t find(const char* pattern, size_t plen) const;
+
+	std::deque<Seg> _segs;
+	size_t _size = 0;
+	size_t _segmentSize;
+};
+
+} // namespace DLNetwork
@@ -32,9 +32,47 @@
 #include "cppdefer.h"
 #include "StringUtil.h"
 #include "SSLWrapper.h"
+#include <limits.h>
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+#ifdef __linux__
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#endif
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define DL_HAS_ZEROCOPY 1
+#endif
 
 using namespace DLNetwork;
 
+#ifndef _WIN32
+// 发送文件的一段，返回值同send。非Linux平台读到用户态再发送
+static ssize_t sendFileRegion(SOCKET sock, int fd, int64_t offset, size_t len)
+{
+#ifdef __linux__
+    off_t off = (off_t)offset;
+    return ::sendfile(sock, fd, &off, len);
+#else
+    char buf[65536];
+    ssize_t r = ::pread(fd, buf, std::min(len, sizeof(buf)), (off_t)offset);
+    if (r <= 0) {
+        return r;
+    }
+    return ::send(sock, buf, r, 0);
+#endif
+}
+#endif
+
+#ifndef _WIN32
+#ifdef IOV_MAX
+static const int kMaxIov = IOV_MAX;
+#else
+static const int kMaxIov = 1024;
+#endif
+#endif
+
 DLNetwork::MyOut& operator<<(DLNetwork::MyOut& o, DLNetwork::Connection& c) {
     o << c.sock() << c.selfAddress().description() << "--" << c.peerAddress().description();
     return o;
@@ -59,8 +97,12 @@ static int alpnCallback(SSL* ssl, const unsigned char** out, unsigned char* outl
 }
 #endif // ENABLE_OPENSSL
 
-Connection::Connection(EventThread *thread, SOCKET sock):_thread(thread),_closing(false),_eventType(EventType::Read),_sock(sock)
+// _readBuf不预分配，第一次读时在所属EventThread上分配，内存落在该线程的NUMA节点
+Connection::Connection(EventThread *thread, SOCKET sock):_readBuf(0),_thread(thread),_closing(false),_eventType(EventType::Read),_sock(sock)
 {
+    if (_thread->edgeTriggered()) {
+        _eventType |= EventType::Edge;
+    }
     //_peerAddr = INetAddress::getPeerAddress(_sock);
     //_selfAddr = INetAddress::getSelfAddress(_sock);
 }
@@ -104,10 +146,14 @@ void Connection::initTls() {
         if (auto conn = weakThis.lock()) {
             DLNetwork::Buffer newBuf;
             newBuf.append(data, len);
-            std::lock_guard<std::mutex> lock(conn->_writeBufMutex);
-            conn->_writeBuf.push_back(std::move(newBuf));
-            conn->_eventType |= EventType::Write;
-            conn->_thread->modifyEvent(conn->_sock, conn->_eventType);
+            {
+                std::lock_guard<std::mutex> lock(conn->_writeBufMutex);
+                conn->_writeBuf.emplace_back(std::move(newBuf));
+                conn->_pendingBytes += len;
+                conn->_eventType |= EventType::Write;
+                conn->_thread->modifyEvent(conn->_sock, conn->_eventType);
+            }
+            conn->checkWriteWatermark();
         }
     });
 
@@ -170,7 +216,7 @@ void Connection::startConnect() {
     }
 
     if (ecode == 0 || uvErr == UV_EAGAIN) {
-        _eventType = EventType::Write;
+        _eventType = (_eventType & EventType::Edge) | EventType::Write;
 		_thread->modifyEvent(_sock, _eventType);
         //_state = State::connecting;
         //mInfo() << "TcpClient::startConnect" << "ecode" << ecode << fsock << _name << _serverAddr.description();
@@ -194,12 +240,34 @@ void Connection::attach() {
     }
     _selfAddr = INetAddress::getSelfAddress(_sock);
 
-    _thread->addEvent(_sock, _eventType, std::bind(&Connection::onEvent, this, std::placeholders::_1, std::placeholders::_2));
+    // io_uring后端由loop批量提交recv，数据直接进_readBuf；其他后端同addEvent
+    _thread->addRecvEvent(_sock, _eventType, [this](int fd, int events) { onEvent(fd, events); },
+        [this](const char* data, int len) { onRecv(data, len); }, _label);
+}
+
+void Connection::setEdgeTriggered(bool on) {
+    if (on) {
+        _eventType |= EventType::Edge;
+    }
+    else {
+        _eventType &= ~EventType::Edge;
+    }
+    if (_attached) {
+        _thread->modifyEvent(_sock, _eventType);
+    }
 }
 
 void Connection::writeInner(const char* buf, size_t size)
 {
     if (size) {
+        if (_fileFeedPending.load(std::memory_order_acquire)) {
+            // 前面还有文件没读完，排在它后面
+            DLNetwork::Buffer newBuf;
+            newBuf.append(buf, size);
+            _fileFeedPending++;
+            writeFeed(WriteChunk(std::move(newBuf)));
+            return;
+        }
 #ifdef ENABLE_OPENSSL
         if (_ssl) {
             if (_thread->isCurrentThread()) {
@@ -215,16 +283,147 @@ void Connection::writeInner(const char* buf, size_t size)
             return;
         } 
 #endif
+        // 直接写进内核的部分不用拷贝
+        size_t sent = trySendDirect(buf, size);
+        if (sent == size) {
+            return;
+        }
         DLNetwork::Buffer newBuf;
-        newBuf.append(buf, size);
+        newBuf.append(buf + sent, size - sent);
+        queueChunk(WriteChunk(std::move(newBuf)));
+    }
+}
 
-        {
-            std::lock_guard<std::mutex> lock(_writeBufMutex);
-            _writeBuf.push_back(std::move(newBuf));
+void Connection::writeInner(WriteChunk&& chunk)
+{
+    if (chunk.readableBytes() == 0) {
+        return;
+    }
+    if (_fileFeedPending.load(std::memory_order_acquire)) {
+        _fileFeedPending++;
+        writeFeed(std::move(chunk));
+        return;
+    }
+    sendChunk(std::move(chunk));
+}
+
+void Connection::sendChunk(WriteChunk&& chunk)
+{
+#ifdef ENABLE_OPENSSL
+    if (_ssl) {
+        // 加密本身就要拷贝，但跨线程时要保证数据在执行前仍然有效
+        if (_thread->isCurrentThread()) {
+            _ssl->sendUnencrypted(chunk.peek(), chunk.readableBytes());
+        } else {
+            std::weak_ptr<Connection> weakThis = shared_from_this();
+            _thread->dispatch([weakThis, chunk = std::move(chunk)]() {
+                if (auto conn = weakThis.lock()) {
+                    conn->_ssl->sendUnencrypted(chunk.peek(), chunk.readableBytes());
+                }
+            });
         }
+        return;
+    }
+#endif
+    size_t sent = trySendDirect(chunk.peek(), chunk.readableBytes());
+    if (sent == chunk.readableBytes()) {
+        return;
+    }
+    chunk.retrieve(sent);
+    queueChunk(std::move(chunk));
+}
 
-        _eventType |= EventType::Write;
-        _thread->modifyEvent(_sock, _eventType);
+// 在连接线程上且发送队列为空时直接写socket，返回写入的字节数，剩下的由调用方入队。
+// 内核缓冲区满或出错都返回已写的部分，错误留给realSend处理
+size_t Connection::trySendDirect(const char* data, size_t len)
+{
+    if (!_thread->isCurrentThread() || !_attached || _closing || (_clientMode && !_clientModeConnected)) {
+        return 0;
+    }
+    if (_zeroCopyThreshold && len >= _zeroCopyThreshold) {
+        // 大块数据入队后由realSend零拷贝发送
+        return 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_writeBufMutex);
+        if (!_writeBuf.empty()) {
+            return 0;
+        }
+    }
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+#endif
+    int n = ::send(_sock, data, (int)std::min(len, (size_t)INT_MAX), flags);
+    if (n <= 0) {
+        return 0;
+    }
+    _thread->addIoBytes(n);
+    _flushStats.directSends++;
+    _flushStats.syscalls++;
+    _flushStats.buffers++;
+    _flushStats.bytes += n;
+    if ((size_t)n == len && _writedcb) {
+        // 与经过发送队列时一样通知写完，异步执行避免在write里重入
+        std::weak_ptr<Connection> weakThis = shared_from_this();
+        _thread->dispatch([weakThis]() {
+            if (auto conn = weakThis.lock()) {
+                if (!conn->_closing && conn->_writedcb && conn->pendingBytes() == 0) {
+                    conn->_writedcb(conn);
+                }
+            }
+        });
+    }
+    return n;
+}
+
+void Connection::queueChunk(WriteChunk&& chunk)
+{
+    size_t pending;
+    {
+        std::lock_guard<std::mutex> lock(_writeBufMutex);
+        pending = (_pendingBytes += chunk.readableBytes());
+        _writeBuf.push_back(std::move(chunk));
+    }
+
+    _eventType |= EventType::Write;
+    _thread->modifyEvent(_sock, _eventType);
+
+    if (_highWatermark && pending >= _highWatermark && !_writeBlocked.load(std::memory_order_relaxed)) {
+        if (_thread->isCurrentThread()) {
+            checkWriteWatermark();
+        }
+        else {
+            std::weak_ptr<Connection> weakThis = shared_from_this();
+            _thread->dispatch([weakThis]() {
+                if (auto conn = weakThis.lock()) {
+                    conn->checkWriteWatermark();
+                }
+            });
+        }
+    }
+}
+
+// 只在连接所在线程调用，保证高低水位回调交替出现
+void Connection::checkWriteWatermark()
+{
+    if (!_highWatermark || _closing) {
+        return;
+    }
+    size_t pending = _pendingBytes.load(std::memory_order_relaxed);
+    if (!_writeBlocked.load(std::memory_order_relaxed)) {
+        if (pending >= _highWatermark) {
+            _writeBlocked.store(true, std::memory_order_relaxed);
+            if (_onHighWatermark) {
+                _onHighWatermark(shared_from_this(), pending);
+            }
+        }
+    }
+    else if (pending <= _lowWatermark) {
+        _writeBlocked.store(false, std::memory_order_relaxed);
+        if (_onLowWatermark) {
+            _onLowWatermark(shared_from_this(), pending);
+        }
     }
 }
 
@@ -237,6 +436,151 @@ void Connection::write(const char * buf, size_t size)
     writeInner(buf, size);
 }
 
+void Connection::write(std::string&& data)
+{
+    if (_closing) {
+        mWarning() << "Connection::write when closing" << data.size();
+        return;
+    }
+    writeInner(WriteChunk(std::move(data)));
+}
+
+void Connection::write(Buffer&& data)
+{
+    if (_closing) {
+        mWarning() << "Connection::write when closing" << data.readableBytes();
+        return;
+    }
+    writeInner(WriteChunk(std::move(data)));
+}
+
+void Connection::write(const SharedSlice& data)
+{
+    if (_closing) {
+        mWarning() << "Connection::write when closing" << data.size();
+        return;
+    }
+    writeInner(WriteChunk(data));
+}
+
+// 把文件段读进buf，用于不能sendfile的情况
+static bool readFileRegion(const FileRegion& file, Buffer& buf)
+{
+    buf.ensureWritableBytes(file.length());
+    size_t done = 0;
+    while (done < file.length()) {
+#ifdef _WIN32
+        if (::_lseeki64(file.fd(), file.offset() + done, SEEK_SET) < 0) {
+            return false;
+        }
+        int n = ::_read(file.fd(), buf.beginWrite(), (unsigned)std::min(file.length() - done, (size_t)INT_MAX));
+#else
+        ssize_t n = ::pread(file.fd(), buf.beginWrite(), file.length() - done, (off_t)(file.offset() + done));
+#endif
+        if (n <= 0) {
+            return false;
+        }
+        buf.hasWritten(n);
+        done += n;
+    }
+    return true;
+}
+
+void Connection::write(const FileRegion& file)
+{
+    if (_closing) {
+        mWarning() << "Connection::write when closing" << file.length();
+        return;
+    }
+    if (!file.valid() || file.length() == 0) {
+        return;
+    }
+    bool inMemory = false;
+#ifdef _WIN32
+    inMemory = true;
+#endif
+#ifdef ENABLE_OPENSSL
+    inMemory = inMemory || _ssl;
+#endif
+    if (inMemory) {
+        // 在调用线程上计数，保证之后的写入都排在文件后面
+        _fileFeedPending++;
+        writeFeed(WriteChunk(file));
+        return;
+    }
+    // 不走直接发送，发送队列为空时由realSend在下一轮发送
+    queueChunk(WriteChunk(file));
+}
+
+void Connection::writeFeed(WriteChunk&& chunk)
+{
+    if (!_thread->isCurrentThread()) {
+        std::weak_ptr<Connection> weakThis = shared_from_this();
+        _thread->dispatch([weakThis, chunk = std::move(chunk)]() mutable {
+            if (auto conn = weakThis.lock()) {
+                conn->writeFeed(std::move(chunk));
+            }
+        });
+        return;
+    }
+    _fileFeed.push_back(std::move(chunk));
+    feedFile();
+}
+
+// 只在连接线程调用。文件每次读kFileFeedChunk字节送进发送路径，
+// 待发数据降到一段以下时才读下一段，由realSend写完一轮后继续
+void Connection::feedFile()
+{
+    if (_inFileFeed) {
+        return;
+    }
+    _inFileFeed = true;
+    size_t fed = 0;
+    while (!_fileFeed.empty() && !_closing && pendingBytes() < kFileFeedChunk && fed < _thread->ioBudget()) {
+        WriteChunk& front = _fileFeed.front();
+        if (!front.isFile()) {
+            WriteChunk chunk(std::move(front));
+            _fileFeed.pop_front();
+            _fileFeedPending--;
+            fed += chunk.readableBytes();
+            sendChunk(std::move(chunk));
+            continue;
+        }
+        size_t len = std::min(front.readableBytes(), kFileFeedChunk);
+        Buffer buf(0);
+        if (!readFileRegion(front.file().slice((size_t)(front.fileOffset() - front.file().offset()), len), buf)) {
+            mWarning() << "Connection::write read file failed" << front.file().fd() << get_uv_errmsg();
+            _inFileFeed = false;
+            close();
+            return;
+        }
+        front.retrieve(len);
+        if (front.readableBytes() == 0) {
+            _fileFeed.pop_front();
+            _fileFeedPending--;
+        }
+        fed += len;
+        sendChunk(WriteChunk(std::move(buf)));
+    }
+    _inFileFeed = false;
+    if (_closing || pendingBytes()) {
+        // 发送队列写完后realSend会再调用
+        return;
+    }
+    if (!_fileFeed.empty()) {
+        // 都直接写进了内核，没有写事件会再触发，通过任务队列稍后继续
+        std::weak_ptr<Connection> weakThis = shared_from_this();
+        _thread->dispatch([weakThis]() {
+            if (auto conn = weakThis.lock()) {
+                conn->feedFile();
+            }
+        });
+    }
+    else if (_closeAfterWrite) {
+        close();
+    }
+}
+
 void Connection::writeInThread(const char * buf, size_t size)
 {
 }
@@ -306,7 +650,7 @@ std::string Connection::description() {
 
 void Connection::closeAfterWrite() {
     std::unique_lock<std::mutex> lock(_writeBufMutex);
-    if (_writeBuf.size() == 0) {
+    if (_writeBuf.size() == 0 && _fileFeedPending.load(std::memory_order_acquire) == 0) {
         lock.unlock();
         close();
     }
@@ -331,10 +675,109 @@ void Connection::onEvent(SOCKET sock, int eventType) {
         return;
     }
     if (eventType & EventType::Error) {
+        // MSG_ZEROCOPY的完成通知也以EPOLLERR报告，读空错误队列后没有真正的错误就继续
+        if (!_zeroCopyInflight.empty() && drainZeroCopyCompletions()) {
+            int ecode = SockUtil::getSockError(sock);
+            if (ecode == 0) {
+                return;
+            }
+            mWarning() << "Connection handleError:" << sock << ecode << uv_strerror(ecode);
+            close();
+            return;
+        }
         handleError(sock);
     }
 }
 
+void Connection::setZeroCopyThreshold(size_t bytes)
+{
+#ifdef DL_HAS_ZEROCOPY
+    if (bytes && !_zeroCopyThreshold) {
+        int one = 1;
+        if (setsockopt(_sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0) {
+            mWarning() << "Connection SO_ZEROCOPY not supported:" << get_uv_errmsg();
+            return;
+        }
+    }
+    _zeroCopyThreshold = bytes;
+#else
+    (void)bytes;
+#endif
+}
+
+int64_t Connection::sendZeroCopy(WriteChunk& chunk)
+{
+#ifdef DL_HAS_ZEROCOPY
+    struct iovec iov;
+    iov.iov_base = (void*)chunk.peek();
+    iov.iov_len = chunk.readableBytes();
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    ssize_t n = ::sendmsg(_sock, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (n < 0 && errno == ENOBUFS) {
+        // 超出optmem限制，这次按普通方式发送
+        return ::send(_sock, iov.iov_base, iov.iov_len, MSG_NOSIGNAL);
+    }
+    if (n > 0) {
+        // 已发出的部分保留到完成通知，剩余部分仍在发送队列中，两者共享同一份数据
+        _zeroCopyInflight.push_back(ZeroCopyPending{ _zeroCopyNextId++, chunk.share().slice(0, n) });
+        _flushStats.zeroCopySends++;
+        _flushStats.zeroCopyBytes += n;
+    }
+    return n;
+#else
+    return ::send(_sock, chunk.peek(), (int)chunk.readableBytes(), 0);
+#endif
+}
+
+// 读错误队列中的零拷贝完成通知并释放对应数据，返回是否读到了通知
+bool Connection::drainZeroCopyCompletions()
+{
+#ifdef DL_HAS_ZEROCOPY
+    bool got = false;
+    for (;;) {
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(_sock, &msg, MSG_ERRQUEUE) < 0) {
+            break;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+                !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            struct sock_extended_err* serr = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            got = true;
+            // 完成的是序号[lo, hi]的发送，序号会回绕
+            uint32_t lo = serr->ee_info;
+            uint32_t hi = serr->ee_data;
+            _zeroCopyInflight.erase(std::remove_if(_zeroCopyInflight.begin(), _zeroCopyInflight.end(), [lo, hi](const ZeroCopyPending& p) {
+                return (uint32_t)(p.id - lo) <= (uint32_t)(hi - lo);
+            }), _zeroCopyInflight.end());
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                // 内核还是做了拷贝(如回环、网卡不支持scatter-gather)，零拷贝只剩额外开销，不再使用
+                _flushStats.zeroCopyCopied += hi - lo + 1;
+                if (_zeroCopyThreshold) {
+                    mDebug() << "Connection MSG_ZEROCOPY fell back to copy, disabled" << _sock;
+                    _zeroCopyThreshold = 0;
+                }
+            }
+        }
+    }
+    return got;
+#else
+    return false;
+#endif
+}
+
 bool Connection::handleReceivedData(const char* buf, size_t size) {
     _readBuf.append(buf, size);
     return readInner();
@@ -363,25 +806,201 @@ bool Connection::readInner() {
         return false;
     }
 }
+void Connection::pauseReading()
+{
+    if (!_thread->isCurrentThread()) {
+        std::weak_ptr<Connection> weakThis = shared_from_this();
+        _thread->dispatch([weakThis]() {
+            if (auto conn = weakThis.lock()) {
+                conn->pauseReading();
+            }
+        });
+        return;
+    }
+    _readPaused = true;
+    updateReadInterest();
+}
+
+void Connection::resumeReading()
+{
+    if (!_thread->isCurrentThread()) {
+        std::weak_ptr<Connection> weakThis = shared_from_this();
+        _thread->dispatch([weakThis]() {
+            if (auto conn = weakThis.lock()) {
+                conn->resumeReading();
+            }
+        });
+        return;
+    }
+    if (!isReadingPaused()) {
+        return;
+    }
+    _readPaused = false;
+    _readCapped = false;
+    updateReadInterest();
+    if (bufferedInput() > 0) {
+        // 可能在MessageCallback里调用，稍后再投递，避免重入
+        std::weak_ptr<Connection> weakThis = shared_from_this();
+        _thread->dispatch([weakThis]() {
+            if (auto conn = weakThis.lock()) {
+                conn->deliverBuffered();
+            }
+        });
+    }
+}
+
+void Connection::updateReadInterest()
+{
+    // 客户端连接建立前只关注写事件，建立后在handleWrite里按暂停状态设置
+    if (_clientMode && !_clientModeConnected) {
+        return;
+    }
+    int type = isReadingPaused() ? (_eventType & ~EventType::Read) : (_eventType | EventType::Read);
+    if (type != _eventType) {
+        _eventType = type;
+        if (_attached && !_closing) {
+            _thread->modifyEvent(_sock, _eventType);
+        }
+    }
+}
+
+size_t Connection::bufferedInput() const
+{
+#ifdef ENABLE_OPENSSL
+    if (_ssl) {
+        return _decodedBuf.readableBytes();
+    }
+#endif
+    return _readBuf.readableBytes();
+}
+
+// 上层处理不完的数据达到上限时撤掉读事件，返回true表示已暂停
+bool Connection::checkReadLimit()
+{
+    if (!_readLimit || _closing || bufferedInput() < _readLimit) {
+        return false;
+    }
+    if (!_readCapped) {
+        _readCapped = true;
+        updateReadInterest();
+    }
+    return true;
+}
+
+void Connection::deliverBuffered()
+{
+    if (_closing || isReadingPaused()) {
+        return;
+    }
+#ifdef ENABLE_OPENSSL
+    if (_ssl) {
+        // 暂停期间io_uring recv带回的密文
+        if (_readBuf.readableBytes() && !readInner()) {
+            return;
+        }
+        if (_decodedBuf.readableBytes() && _messageCb) {
+            _messageCb(shared_from_this(), &_decodedBuf);
+            checkReadLimit();
+        }
+        return;
+    }
+#endif
+    if (_readBuf.readableBytes() && readInner()) {
+        checkReadLimit();
+    }
+}
+
 bool Connection::handleRead(SOCKET sock)
 {
     if (_closing) {
         return false;
     }
+    if (isReadingPaused()) {
+        // 暂停前已取到的事件或边沿触发的续读任务
+        return true;
+    }
 
-    int ecode = 0;
-    int32_t n = _readBuf.readFd(sock, &ecode);
-    if (n > 0) {
-        return readInner();
+    // 水平触发每次唤醒只读一次；边沿触发读到EAGAIN为止，超出预算则让出给其他fd
+    const bool edge = isEdgeTriggered();
+    const size_t budget = _thread->ioBudget();
+    size_t total = 0;
+    for (;;) {
+        int ecode = 0;
+        int32_t n = _readBuf.readFd(sock, &ecode);
+        if (n > 0) {
+            total += n;
+            _thread->addIoBytes(n);
+            if (!readInner()) {
+                return false;
+            }
+            // 消息处理完读缓冲为空时释放过大的存储，连接空闲期间不占内存
+            _readBuf.shrinkIfIdle();
+            // 回调里暂停了读或者缓冲达到上限，剩下的数据留在内核里
+            if (checkReadLimit() || _readPaused) {
+                return !_closing;
+            }
+            if (!edge || _closing) {
+                return !_closing;
+            }
+            if (total >= budget) {
+                // 内核中可能还有数据，但边沿触发不会再通知，通过任务队列稍后继续读
+                std::weak_ptr<Connection> weakThis = shared_from_this();
+                _thread->dispatch([weakThis]() {
+                    if (auto conn = weakThis.lock()) {
+                        conn->handleRead(conn->_sock);
+                    }
+                });
+                return true;
+            }
+        }
+        else if (n == 0) {
+            close();
+            return false;
+        }
+        else {
+            int err = get_uv_error();
+            if (err == UV_EINTR) {
+                continue;
+            }
+            if (err == UV_EAGAIN) {
+                return true;
+            }
+            mWarning() << "Connection read" << sock << "error:" << ecode << uv_strerror(err);
+            close();
+            return false;
+        }
+    }
+}
+
+// io_uring recv完成，与handleRead读到数据后的处理相同
+void Connection::onRecv(const char* data, int len)
+{
+    if (_closing) {
+        return;
+    }
+    if (len > 0) {
+        _thread->addIoBytes(len);
+        _readBuf.append(data, len);
+        if (isReadingPaused()) {
+            // 暂停前提交的recv带回的数据，恢复读时由deliverBuffered投递
+            return;
+        }
+        if (!readInner()) {
+            return;
+        }
+        _readBuf.shrinkIfIdle();
+        checkReadLimit();
     }
-    else if (n == 0) {
+    else if (len == 0) {
+        if (isReadingPaused()) {
+            // 恢复读后重新recv还会读到EOF，届时再关闭，先投递已缓冲的数据
+            return;
+        }
         close();
-        return false;
     }
     else {
-        mWarning() << "Connection read" << sock << "error:" << ecode << get_uv_errmsg();
+        mWarning() << "Connection recv" << _sock << "error:" << len << uv_strerror(len);
         close();
-        return false;
     }
 }
 
@@ -394,7 +1013,7 @@ bool Connection::handleWrite(SOCKET sock)
         _peerAddr = INetAddress::getPeerAddress(_sock);
         _selfAddr = INetAddress::getSelfAddress(_sock);
         _clientModeConnected = true;
-        _eventType = EventType::Read;
+        _eventType = (_eventType & EventType::Edge) | (isReadingPaused() ? 0 : EventType::Read);
         _thread->modifyEvent(_sock, _eventType);
         if (_connectionCb) {
             mDebug() << "Connection::handleWrite established notify" << this->description().c_str();
@@ -415,19 +1034,96 @@ bool DLNetwork::Connection::realSend()
         }
     }
 
+    const size_t budget = _thread->ioBudget();
+    size_t total = 0;
+    bool yielded = false;
+    if (!writeBufTmp.empty()) {
+        _flushStats.flushes++;
+    }
     while (!writeBufTmp.empty()) {
-        auto &buf = writeBufTmp.front();
-        // 发送数据（在锁外进行）
-        int n = ::send(_sock, buf.peek(), buf.readableBytes(), 0);
+        if (total >= budget) {
+            yielded = true;
+            break;
+        }
+        // 发送数据（在锁外进行），一次系统调用最多带kMaxIov个buffer
+#ifndef _WIN32
+        struct iovec iov[kMaxIov];
+        int cnt = 0;
+        size_t want = 0;
+        ssize_t n;
+        bool fileChunk = writeBufTmp.front().isFile();
+        if (fileChunk) {
+            auto& file = writeBufTmp.front();
+            cnt = 1;
+            want = file.readableBytes();
+            n = sendFileRegion(_sock, file.file().fd(), file.fileOffset(), want);
+            if (n == 0) {
+                // 文件比登记的区间短(发送期间被截断)
+                mWarning() << "Connection sendfile: file ended before region" << _sock;
+                close();
+                return false;
+            }
+        }
+        else if (_zeroCopyThreshold && writeBufTmp.front().readableBytes() >= _zeroCopyThreshold) {
+            cnt = 1;
+            want = writeBufTmp.front().readableBytes();
+            n = sendZeroCopy(writeBufTmp.front());
+        }
+        else {
+            for (auto it = writeBufTmp.begin(); it != writeBufTmp.end() && cnt < kMaxIov; ++it, ++cnt) {
+                // 文件段和大块留到下一次单独发送
+                if (it->isFile() || (_zeroCopyThreshold && it->readableBytes() >= _zeroCopyThreshold)) {
+                    break;
+                }
+                iov[cnt].iov_base = (void*)it->peek();
+                iov[cnt].iov_len = it->readableBytes();
+                want += it->readableBytes();
+            }
+            n = ::writev(_sock, iov, cnt);
+        }
+#else
+        int cnt = 1;
+        size_t want = writeBufTmp.front().readableBytes();
+        bool fileChunk = false;
+        int n = ::send(_sock, writeBufTmp.front().peek(), (int)want, 0);
+#endif
         if (n >= 0) {
-            if (n == buf.readableBytes()) {
+            total += n;
+            _pendingBytes -= n;
+            _thread->addIoBytes(n);
+            _flushStats.syscalls++;
+            _flushStats.buffers += cnt;
+            _flushStats.bytes += n;
+            // 写完的buffer出队，写了一部分的跨buffer边界继续retrieve
+            size_t left = n;
+            while (!writeBufTmp.empty()) {
+                auto& buf = writeBufTmp.front();
+                if (left < buf.readableBytes()) {
+                    buf.retrieve(left);
+                    break;
+                }
+                left -= buf.readableBytes();
                 writeBufTmp.pop_front();
-            } else {
-                buf.retrieve(n);
+            }
+            if ((size_t)n < want) {
+                if (fileChunk) {
+                    // sendfile一次可能只发一部分(如受单次上限或页缓存影响)，并不代表socket已满，
+                    // 边沿触发下必须写到EAGAIN才会再有通知
+                    continue;
+                }
+                // socket发送缓冲区已满
+                _flushStats.partialWrites++;
                 break;
             }
         } else {
-            mWarning() << "Connection::handleWrite error:" << get_uv_errmsg();
+            int err = get_uv_error();
+            if (err == UV_EINTR) {
+                continue;
+            }
+            if (err == UV_EAGAIN) {
+                break;
+            }
+            mWarning() << "Connection::handleWrite error:" << uv_strerror(err);
             close();
             return false;
         }
@@ -435,14 +1131,43 @@ bool DLNetwork::Connection::realSend()
     // 回滚未发送完毕的数据
     if (!writeBufTmp.empty()) {
         // 有剩余数据
-        std::lock_guard<std::mutex> lock(_writeBufMutex);
-        writeBufTmp.swap(_writeBuf);
-        _writeBuf.insert(_writeBuf.end(), writeBufTmp.begin(), writeBufTmp.end());
+        {
+            std::lock_guard<std::mutex> lock(_writeBufMutex);
+            writeBufTmp.swap(_writeBuf);
+            _writeBuf.insert(_writeBuf.end(), std::make_move_iterator(writeBufTmp.begin()), std::make_move_iterator(writeBufTmp.end()));
+        }
+        checkWriteWatermark();
+        if (!_fileFeed.empty()) {
+            feedFile();
+        }
+        if (yielded && isEdgeTriggered()) {
+            // socket仍可写，边沿触发不会再通知，通过任务队列稍后继续写
+            std::weak_ptr<Connection> weakThis = shared_from_this();
+            _thread->dispatch([weakThis]() {
+                if (auto conn = weakThis.lock()) {
+                    if (!conn->_closing) {
+                        conn->realSend();
+                    }
+                }
+            });
+        }
     }
     else{
         _eventType &= ~EventType::Write;
         _thread->modifyEvent(_sock, _eventType);
-        
+        // 回调里可能继续写，要在清掉写事件之后
+        checkWriteWatermark();
+        if (!_fileFeed.empty()) {
+            feedFile();
+            if (_closing) {
+                return false;
+            }
+            if (pendingBytes() || !_fileFeed.empty()) {
+                // 文件还没发完，写完后再通知
+                return true;
+            }
+        }
+
         if (_writedcb) {
             _writedcb(shared_from_this());
         }
@@ -27,10 +27,12 @@
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <deque>
 #include "EventThread.h"
 #include "sockutil.h"
 #include "Buffer.h"
+#include "WriteChunk.h"
 #include "INetAddress.h"
 #include "MyLog.h"
 #include "SSLWrapper.h"
@@ -46,9 +48,10 @@ class Connection : public std::enable_shared_from_this<Connection>
 {
 public:
     using Ptr = std::shared_ptr<Connection>;
-    typedef std::function<void(Connection::Ptr conn, ConnectEvent e)> ConnectionCallback;
-    typedef std::function<bool(Connection::Ptr conn, DLNetwork::Buffer*)> MessageCallback;
-    typedef std::function<void(Connection::Ptr conn)> WritedCallback;
+    typedef SmallFunction<void(Connection::Ptr conn, ConnectEvent e)> ConnectionCallback;
+    typedef SmallFunction<bool(Connection::Ptr conn, DLNetwork::Buffer*)> MessageCallback;
+    typedef SmallFunction<void(Connection::Ptr conn)> WritedCallback;
+    typedef SmallFunction<void(Connection::Ptr conn, size_t pending)> WatermarkCallback;
 
     virtual ~Connection();
 #ifdef ENABLE_OPENSSL
@@ -103,15 +106,72 @@ public:
         _peerAddr = addr;
     }
     void setConnectCallback(ConnectionCallback cb) {
-        _connectionCb = cb;
+        _connectionCb = std::move(cb);
     }
     void setOnMessage(MessageCallback cb) {
-        _messageCb = cb;
+        _messageCb = std::move(cb);
     }
     void setOnWriteDone(WritedCallback cb) {
-        _writedcb = cb;
+        _writedcb = std::move(cb);
     }
+    // 发送队列达到high字节时回调onHighWatermark，之后降到low及以下时回调onLowWatermark，
+    // 两个回调成对出现，都在连接所在线程执行。high为0表示不检查(默认)
+    void setWriteWatermarks(size_t high, size_t low) {
+        _highWatermark = high;
+        _lowWatermark = low < high ? low : high / 2;
+    }
+    void setOnHighWatermark(WatermarkCallback cb) {
+        _onHighWatermark = std::move(cb);
+    }
+    void setOnLowWatermark(WatermarkCallback cb) {
+        _onLowWatermark = std::move(cb);
+    }
+    // 发送队列中还没写进内核的字节数，可在任意线程调用
+    size_t pendingBytes() const {
+        return _pendingBytes.load(std::memory_order_relaxed);
+    }
+    // 已回调onHighWatermark且还没回落到低水位
+    bool writeBlocked() const {
+        return _writeBlocked.load(std::memory_order_relaxed);
+    }
+    // EventThread统计慢回调时用来标识来源，需在attach前设置，label需长期有效
+    void setLabel(const char* label) {
+        _label = label;
+    }
+    // 边沿触发: 每次唤醒循环读写直到EAGAIN，单次最多EventThread::ioBudget()字节
+    void setEdgeTriggered(bool on);
+    bool isEdgeTriggered() const {
+        return _eventType & EventType::Edge;
+    }
+    // 暂停读：撤掉读事件，数据留在内核缓冲区，由TCP流控让对端慢下来。可在任意线程调用
+    void pauseReading();
+    // 恢复读，暂停期间留在读缓冲里的数据会重新交给MessageCallback
+    void resumeReading();
+    // 只在连接所在线程读
+    bool isReadingPaused() const {
+        return _readPaused || _readCapped;
+    }
+    // MessageCallback处理后读缓冲中仍有bytes以上数据时自动暂停读，直到resumeReading。0表示不限制(默认)
+    void setReadBufferLimit(size_t bytes) {
+        _readLimit = bytes;
+    }
+    // 发送队列中单块数据不小于bytes时用MSG_ZEROCOPY发送，数据一直保留到内核在错误队列上通知完成。
+    // 0表示关闭(默认)。内核不支持SO_ZEROCOPY，或通知说实际做了拷贝(如回环)时退回普通发送。需在连接线程调用
+    void setZeroCopyThreshold(size_t bytes);
+    // 读之前用FIONREAD查询可读字节数按需预留读缓冲，适合消息大小差异大的连接，每次读多一次ioctl
+    void setReadHintFionread(bool on) {
+        _readBuf.setReadHintFionread(on);
+    }
+    // 拷贝数据后入队，可在任意线程调用
     void write(const char* buf, size_t size);
+    // 以下重载接管数据不拷贝，直接进入发送队列，内核接收完后释放
+    void write(std::string&& data);
+    void write(Buffer&& data);
+    // slice可同时发给多个连接，只增加引用计数
+    void write(const SharedSlice& data);
+    // 文件段与内存数据按顺序排队，用sendfile从文件直接发往socket，计入pendingBytes。
+    // TLS连接和Windows上每次读64KB进内存发送，待发数据低于一段时再读下一段
+    void write(const FileRegion& file);
     void close(bool notify=true);
     void reset();
     EventThread* getThread() {
@@ -139,6 +199,22 @@ public:
     }
     std::string description();
     void closeAfterWrite();
+
+    // 发送统计，只在连接所在线程更新
+    struct FlushStats {
+        uint64_t flushes = 0;       // realSend被调用且有数据待发的次数
+        uint64_t syscalls = 0;      // writev/send次数
+        uint64_t buffers = 0;       // 各次系统调用带的buffer数之和
+        uint64_t bytes = 0;
+        uint64_t partialWrites = 0; // 未写完就遇到发送缓冲区满的次数
+        uint64_t directSends = 0;   // write时发送队列为空直接发送的次数，也计入syscalls
+        uint64_t zeroCopySends = 0; // MSG_ZEROCOPY发送次数，也计入syscalls
+        uint64_t zeroCopyBytes = 0;
+        uint64_t zeroCopyCopied = 0; // 完成通知中标明内核仍做了拷贝的发送次数
+    };
+    const FlushStats& flushStats() const {
+        return _flushStats;
+    }
 protected:
     template<typename ConnectionType>
     static Ptr create(EventThread* thread, SOCKET sock) {
@@ -163,17 +239,31 @@ protected:
     Connection(EventThread* thread, SOCKET sock);
 
     void writeInner(const char* buf, size_t size);
+    void writeInner(WriteChunk&& chunk);
+    void sendChunk(WriteChunk&& chunk);
+    void writeFeed(WriteChunk&& chunk);
+    void feedFile();
+    size_t trySendDirect(const char* data, size_t len);
+    void queueChunk(WriteChunk&& chunk);
+    int64_t sendZeroCopy(WriteChunk& chunk);
+    bool drainZeroCopyCompletions();
     bool readInner();
     void onEvent(SOCKET sock, int eventType);
+    void onRecv(const char* data, int len);
     bool handleRead(SOCKET sock);
     bool handleWrite(SOCKET sock);
     bool realSend();
+    void checkWriteWatermark();
+    void updateReadInterest();
+    bool checkReadLimit();
+    size_t bufferedInput() const;
+    void deliverBuffered();
     void handleHangup(SOCKET sock);
     void handleError(SOCKET sock);
     void writeInThread(const char* buf, size_t size);
 
     DLNetwork::Buffer _readBuf;
-    std::deque<DLNetwork::Buffer> _writeBuf;
+    std::deque<WriteChunk> _writeBuf;
     SOCKET _sock;
     EventThread* _thread;
     ConnectionCallback _connectionCb;
@@ -191,6 +281,30 @@ protected:
     bool _clientMode = false;
     bool _clientModeConnected = false;
     bool _attached = false;
+    const char* _label = nullptr;
+    FlushStats _flushStats;
+    std::atomic<size_t> _pendingBytes{0};
+    size_t _highWatermark = 0;
+    size_t _lowWatermark = 0;
+    std::atomic<bool> _writeBlocked{false};
+    WatermarkCallback _onHighWatermark;
+    WatermarkCallback _onLowWatermark;
+    bool _readPaused = false;   // pauseReading
+    bool _readCapped = false;   // 读缓冲达到_readLimit
+    size_t _readLimit = 0;
+    // MSG_ZEROCOPY已发出、等待完成通知的数据，id为内核按每次发送递增的序号
+    struct ZeroCopyPending {
+        uint32_t id;
+        SharedSlice data;
+    };
+    std::deque<ZeroCopyPending> _zeroCopyInflight;
+    size_t _zeroCopyThreshold = 0;
+    uint32_t _zeroCopyNextId = 0;
+    // TLS连接和Windows上文件分段读进内存发送，文件及排在它后面的写入先进这里，只在连接线程访问
+    static constexpr size_t kFileFeedChunk = 64 * 1024;
+    std::deque<WriteChunk> _fileFeed;
+    std::atomic<size_t> _fileFeedPending{0}; // 已交给_fileFeed还没送进发送路径的项数，任意线程写入时检查
+    bool _inFileFeed = false;
 
     friend class UdpServer;
 };
@@ -0,0 +1,181 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "Coroutine.h"
+
+#ifdef DL_HAS_COROUTINE
+#include "TcpConnection.h"
+#include "sockutil.h"
+#include "MyLog.h"
+#include "uv_errno.h"
+
+using namespace DLNetwork;
+
+void detail::Detached::promise_type::unhandled_exception() noexcept {
+	try {
+		throw;
+	}
+	catch (std::exception& ex) {
+		mCritical() << "coroutine exception:" << ex.what();
+	}
+	catch (...) {
+		mCritical() << "coroutine unknown exception";
+	}
+}
+
+static detail::Detached runDetached(Task<void> task) {
+	co_await std::move(task);
+}
+
+void DLNetwork::spawn(Task<void> task) {
+	runDetached(std::move(task));
+}
+
+CoConnection::CoConnection(Connection::Ptr conn) : _conn(std::move(conn)) {
+	_conn->setOnMessage([this](Connection::Ptr, Buffer* buf) { return onMessage(buf); });
+	_conn->setOnWriteDone([this](Connection::Ptr) { onWriteDone(); });
+	_conn->setConnectCallback([this](Connection::Ptr, ConnectEvent e) {
+		if (e == ConnectEvent::Closed) {
+			onClosed();
+		}
+	});
+	_conn->attach();
+}
+
+CoConnection::~CoConnection() {
+	if (!_closed) {
+		_closed = true;
+		_conn->close(false);
+	}
+	_conn->setOnMessage(nullptr);
+	_conn->setOnWriteDone(nullptr);
+	_conn->setConnectCallback(nullptr);
+}
+
+bool CoConnection::onMessage(Buffer* buf) {
+	_buf = buf;
+	if (_reader && buf->readableBytes() >= _want) {
+		// 恢复后协程可能已结束并析构本对象，之后不能再访问成员
+		std::exchange(_reader, {}).resume();
+	}
+	return true;
+}
+
+void CoConnection::onWriteDone() {
+	_writing = false;
+	if (_writer) {
+		std::exchange(_writer, {}).resume();
+	}
+}
+
+void CoConnection::onClosed() {
+	_closed = true;
+	auto reader = std::exchange(_reader, {});
+	auto writer = std::exchange(_writer, {});
+	if (reader) {
+		reader.resume();
+	}
+	if (writer) {
+		writer.resume();
+	}
+}
+
+CoConnection::WriteAwaiter CoConnection::write(const char* buf, size_t size) {
+	assert(_conn->getThread()->isCurrentThread());
+	if (size && !_closed) {
+		_writing = true;
+		_conn->write(buf, size);
+	}
+	return { this };
+}
+
+void CoConnection::close() {
+	if (!_closed) {
+		// 通知onClosed，恢复等待中的读写者
+		_conn->close(true);
+	}
+}
+
+CoAcceptor::~CoAcceptor() {
+	close();
+}
+
+bool CoAcceptor::listen(INetAddress listenAddr, bool reusePort) {
+	if (listenAddr.isIP4()) {
+		_listenSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	}
+	else if (listenAddr.isIP6()) {
+		_listenSock = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+	}
+	else {
+		mCritical() << "CoAcceptor::listen invalid listenAddr" << listenAddr.description();
+		return false;
+	}
+	if (_listenSock == INVALID_SOCKET) {
+		return false;
+	}
+	SockUtil::setNoBlocked(_listenSock, true);
+	SockUtil::setReuseable(_listenSock, reusePort);
+	int ret = 0;
+	if (listenAddr.isIP4()) {
+		ret = ::bind(_listenSock, (sockaddr*)&listenAddr.addr4(), sizeof(listenAddr.addr4()));
+	}
+	else {
+		ret = ::bind(_listenSock, (sockaddr*)&listenAddr.addr6(), sizeof(listenAddr.addr6()));
+	}
+	if (ret != 0 || ::listen(_listenSock, SOMAXCONN) < 0) {
+		mWarning() << "CoAcceptor listen error" << get_uv_errmsg();
+		myclose(_listenSock);
+		_listenSock = INVALID_SOCKET;
+		return false;
+	}
+	_thread->addEvent(_listenSock, EventType::Read, [this](int fd, int) { onEvent(fd); }, "CoAcceptor");
+	return true;
+}
+
+void CoAcceptor::close() {
+	if (_listenSock == INVALID_SOCKET) {
+		return;
+	}
+	_thread->removeEvents(_listenSock);
+	myclose(_listenSock);
+	_listenSock = INVALID_SOCKET;
+	if (_waiter) {
+		std::exchange(_waiter, {}).resume();
+	}
+}
+
+void CoAcceptor::onEvent(SOCKET sock) {
+	for (;;) {
+		SOCKET fsock = ::accept(sock, nullptr, nullptr);
+		if (fsock == INVALID_SOCKET) {
+			break;
+		}
+		_pending.push_back(TcpConnection::create(nullptr, fsock));
+	}
+	if (_waiter && !_pending.empty()) {
+		std::exchange(_waiter, {}).resume();
+	}
+}
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+// C++20协程接口，需要以-std=c++20编译，C++17下本文件为空
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define DL_HAS_COROUTINE 1
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "EventThread.h"
+#include "Connection.h"
+#include "INetAddress.h"
+
+namespace DLNetwork {
+
+/// 惰性启动的协程返回类型，被co_await时才开始执行，结束时直接切回等待者(对称转移)
+/// 顶层协程用spawn启动
+template<typename T = void>
+class Task;
+
+namespace detail {
+
+struct PromiseBase {
+	struct FinalAwaiter {
+		bool await_ready() noexcept { return false; }
+		template<typename P>
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+			auto next = h.promise().continuation;
+			return next ? next : std::noop_coroutine();
+		}
+		void await_resume() noexcept {}
+	};
+
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	FinalAwaiter final_suspend() noexcept { return {}; }
+	void unhandled_exception() { exception = std::current_exception(); }
+
+	std::coroutine_handle<> continuation;
+	std::exception_ptr exception;
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+	Task<T> get_return_object() noexcept;
+	template<typename U>
+	void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+	T result() {
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+		return std::move(*value);
+	}
+	std::optional<T> value;
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+	Task<void> get_return_object() noexcept;
+	void return_void() noexcept {}
+	void result() {
+		if (exception) {
+			std::rethrow_exception(exception);
+		}
+	}
+};
+
+} // namespace detail
+
+template<typename T>
+class Task
+{
+public:
+	using promise_type = detail::Promise<T>;
+	using Handle = std::coroutine_handle<promise_type>;
+
+	Task() noexcept {}
+	explicit Task(Handle h) noexcept : _h(h) {}
+	Task(Task&& other) noexcept : _h(std::exchange(other._h, {})) {}
+	Task& operator=(Task&& other) noexcept {
+		if (this != &other) {
+			if (_h) {
+				_h.destroy();
+			}
+			_h = std::exchange(other._h, {});
+		}
+		return *this;
+	}
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+	~Task() {
+		if (_h) {
+			_h.destroy();
+		}
+	}
+
+	bool await_ready() const noexcept { return !_h || _h.done(); }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+		_h.promise().continuation = caller;
+		return _h;
+	}
+	T await_resume() { return _h.promise().result(); }
+
+private:
+	Handle _h;
+};
+
+namespace detail {
+
+template<typename T>
+inline Task<T> Promise<T>::get_return_object() noexcept {
+	return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+	return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// spawn用的自销毁协程
+struct Detached {
+	struct promise_type {
+		Detached get_return_object() noexcept { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() noexcept {}
+		void unhandled_exception() noexcept;
+	};
+};
+
+} // namespace detail
+
+// 在当前线程立即开始执行task，直到第一次挂起；task结束后自动释放，未捕获的异常只打印日志
+void spawn(Task<void> task);
+
+// 切换到thread上继续执行，已在该线程时不挂起
+struct SwitchAwaiter {
+	EventThread* thread;
+	bool await_ready() const { return thread->isCurrentThread(); }
+	void await_suspend(std::coroutine_handle<> h) {
+		thread->dispatch([h]() { h.resume(); });
+	}
+	void await_resume() const noexcept {}
+};
+inline SwitchAwaiter switchTo(EventThread* thread) { return { thread }; }
+
+// 在当前EventThread上等待，由TimerManager的timer直接恢复。timer从空闲链表复用，不做堆分配
+// 协程帧在等待中被销毁时(如持有Task的一方提前析构)，析构里删除timer，之后到期也不会恢复已销毁的帧
+struct SleepAwaiter {
+	SleepAwaiter(EventThread* thread, unsigned int ms, std::chrono::microseconds us) : thread(thread), ms(ms), us(us) {}
+	SleepAwaiter(const SleepAwaiter&) = delete;
+	SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+	~SleepAwaiter() {
+		if (timer) {
+			thread->delTimer(timer);
+		}
+	}
+
+	bool await_ready() const noexcept { return ms == 0 && us.count() == 0; }
+	void await_suspend(std::coroutine_handle<> h) {
+		auto resume = [this, h](void*) {
+			// 恢复后本对象可能随帧一起析构，先清掉句柄
+			timer = TimerId();
+			h.resume();
+			return 0;
+		};
+		if (us.count()) {
+			timer = thread->addTimer(us, resume);
+		}
+		else {
+			timer = thread->addTimer(ms, resume);
+		}
+	}
+	void await_resume() const noexcept {}
+
+	EventThread* thread;
+	unsigned int ms;
+	std::chrono::microseconds us;
+	TimerId timer;
+};
+inline SleepAwaiter sleep(EventThread* thread, unsigned int ms) { return { thread, ms, std::chrono::microseconds(0) }; }
+inline SleepAwaiter sleep(EventThread* thread, std::chrono::microseconds us) { return { thread, 0, us }; }
+
+/// 以协程方式使用Connection，接管连接的回调并attach
+/// 读写只能在连接所在线程await(先co_await switchTo(conn->getThread()))，之后由连接的回调直接恢复，不经过任务队列
+/// 同一时刻最多一个读者和一个写者。析构时关闭连接
+class CoConnection
+{
+public:
+	explicit CoConnection(Connection::Ptr conn);
+	~CoConnection();
+	CoConnection(const CoConnection&) = delete;
+	CoConnection& operator=(const CoConnection&) = delete;
+
+	struct ReadAwaiter {
+		CoConnection* c;
+		size_t n;
+		bool await_ready() const noexcept { return c->_closed || c->readable() >= n; }
+		void await_suspend(std::coroutine_handle<> h) noexcept {
+			c->_want = n;
+			c->_reader = h;
+		}
+		// 连接关闭时返回nullptr
+		Buffer* await_resume() const noexcept { return c->readable() >= n ? c->_buf : nullptr; }
+	};
+	struct WriteAwaiter {
+		CoConnection* c;
+		bool await_ready() const noexcept { return c->_closed || !c->_writing; }
+		void await_suspend(std::coroutine_handle<> h) noexcept { c->_writer = h; }
+		// 连接关闭时返回false
+		bool await_resume() const noexcept { return !c->_closed; }
+	};
+
+	// 等到读缓冲中至少有n字节(至少1字节)，返回读缓冲，调用方自行retrieve已处理的数据
+	// 数据足够时连接关闭也先返回剩余数据，之后返回nullptr
+	ReadAwaiter read(size_t n = 1) {
+		assert(_conn->getThread()->isCurrentThread());
+		return { this, n ? n : 1 };
+	}
+	// 写入发送队列，等发送队列写空后恢复
+	WriteAwaiter write(const char* buf, size_t size);
+	WriteAwaiter write(const std::string& s) { return write(s.data(), s.size()); }
+	void close();
+
+	bool closed() const { return _closed; }
+	Connection::Ptr& connection() { return _conn; }
+
+private:
+	size_t readable() const { return _buf ? _buf->readableBytes() : 0; }
+	bool onMessage(Buffer* buf);
+	void onWriteDone();
+	void onClosed();
+
+	Connection::Ptr _conn;
+	Buffer* _buf = nullptr; // 连接的读缓冲
+	size_t _want = 0;
+	bool _writing = false;
+	bool _closed = false;
+	std::coroutine_handle<> _reader;
+	std::coroutine_handle<> _writer;
+};
+
+/// 监听TCP端口，co_await accept()得到新连接
+/// 新连接按EventThreadPool的策略分配线程，尚未attach，一般交给CoConnection后spawn处理协程
+class CoAcceptor
+{
+public:
+	explicit CoAcceptor(EventThread* thread) : _thread(thread) {}
+	~CoAcceptor();
+	CoAcceptor(const CoAcceptor&) = delete;
+	CoAcceptor& operator=(const CoAcceptor&) = delete;
+
+	bool listen(INetAddress listenAddr, bool reusePort = true);
+	void close();
+
+	struct AcceptAwaiter {
+		CoAcceptor* a;
+		bool await_ready() const noexcept { return !a->_pending.empty() || a->_listenSock == INVALID_SOCKET; }
+		void await_suspend(std::coroutine_handle<> h) noexcept { a->_waiter = h; }
+		// 关闭后返回nullptr
+		Connection::Ptr await_resume() {
+			if (a->_pending.empty()) {
+				return nullptr;
+			}
+			Connection::Ptr conn = std::move(a->_pending.front());
+			a->_pending.pop_front();
+			return conn;
+		}
+	};
+	// 只能在监听所在线程await
+	AcceptAwaiter accept() {
+		assert(_thread->isCurrentThread());
+		return { this };
+	}
+
+private:
+	void onEvent(SOCKET sock);
+
+	EventThread* _thread;
+	SOCKET _listenSock = INVALID_SOCKET;
+	std::deque<Connection::Ptr> _pending;
+	std::coroutine_handle<> _waiter;
+};
+
+} // namespace DLNetwork
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "EventNotifier.h"
+#include <stdexcept>
+#include <stdint.h>
+#include <platform.h>
+#include "uv_errno.h"
+#include "MyLog.h"
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+using namespace DLNetwork;
+
+#if defined(__linux__)
+
+EventNotifier::EventNotifier() {
+	reOpen();
+}
+
+EventNotifier::~EventNotifier() {
+	clearFD();
+}
+
+int EventNotifier::readFD() const {
+	return _fd;
+}
+
+void EventNotifier::reOpen() {
+	clearFD();
+	_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (_fd == -1) {
+		mCritical() << "create eventfd failed:" << get_uv_errmsg();
+		throw std::runtime_error("create eventfd failed");
+	}
+}
+
+void EventNotifier::clearFD() {
+	if (_fd != -1) {
+		myclose(_fd);
+		_fd = -1;
+	}
+}
+
+void EventNotifier::notify() {
+	uint64_t one = 1;
+	int ret;
+	do {
+		ret = ::write(_fd, &one, sizeof(one));
+	} while (-1 == ret && errno == EINTR);
+	// EAGAIN只在计数器溢出时出现，此时fd必然可读，无需处理
+}
+
+bool EventNotifier::drain() {
+	uint64_t count = 0;
+	int ret;
+	do {
+		ret = ::read(_fd, &count, sizeof(count));
+	} while (-1 == ret && errno == EINTR);
+	return ret == sizeof(count) || (ret == -1 && errno == EAGAIN);
+}
+
+#else
+
+EventNotifier::EventNotifier() {
+}
+
+EventNotifier::~EventNotifier() {
+}
+
+int EventNotifier::readFD() const {
+	return _pipe.readFD();
+}
+
+void EventNotifier::reOpen() {
+	_pipe.reOpen();
+}
+
+void EventNotifier::notify() {
+	_pipe.write("", 1);
+}
+
+bool EventNotifier::drain() {
+	char buf[1024];
+	do {
+		int ret = _pipe.read(buf, sizeof(buf));
+		if (ret > 0) {
+			continue;
+		}
+		return ret != 0 && get_uv_error(true) == UV_EAGAIN;
+	} while (true);
+}
+
+#endif // defined(__linux__)
@@ -29,9 +29,11 @@
 #include <algorithm>
 #include <stdio.h>
 #include <atomic>
+#include <random>
 #include <MyLog.h>
 #include "uv_errno.h"
 #include "ThreadName.h"
+#include "CpuTopology.h"
 #ifdef _USE_EPOLL_
 #ifdef _WIN32_
 #include <wepoll.h>
@@ -39,6 +41,12 @@
 #include <sys/epoll.h>
 #endif
 #endif
+#if defined(_USE_EPOLL_) && defined(__linux__)
+#define HAVE_TIMERFD
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <string.h>
+#endif
 
 #define ToPoll(type) (type&EventType::Read ? POLLIN:0) | (type&EventType::Write ? POLLOUT:0) | (type&EventType::Error ? POLLERR:0) | (type&EventType::Hangup ? POLLHUP:0)
 #define ToEventType(rev) (rev&POLLIN?EventType::Read:0) | (rev&POLLOUT?EventType::Write:0) | (rev&POLLERR?EventType::Error:0) |  (rev&POLLHUP?EventType::Hangup:0)
@@ -53,13 +61,51 @@ static inline uint64_t getCurrentMicrosecondEpoch() {
 #endif
 }
 
+static inline uint64_t monotonicNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 using namespace DLNetwork;
 
-EventThread::EventThread(bool fromCurrentThread) :_threadCancel(false) {
+#ifdef _USE_EPOLL_
+static inline uint32_t toEpollEvents(int type) {
+	uint32_t events = 0;
+	if (type & EventType::Read) events |= EPOLLIN;
+	if (type & EventType::Write) events |= EPOLLOUT;
+	if (type & EventType::Edge) events |= EPOLLET;
+	return events;
+}
+#endif
+
+EventThread::EventThread(bool fromCurrentThread, IoBackend backend) :_threadCancel(false) {
     static std::atomic<int> n(1);
     char buf[64];
     snprintf(buf, sizeof(buf), "EventThread %d", n.load(std::memory_order_acquire));
     n++;
+
+    #ifdef _USE_EPOLL_
+    _epollfd = epoll_create(1);
+    if (_epollfd < 0) {
+        mCritical() << "epoll_create failed:" << strerror(errno);
+    }
+    _epollEvents.resize(_maxEvents < kInitialEvents ? _maxEvents : kInitialEvents);
+    #endif
+
+	if (backend == IoBackend::IoUring) {
+		_uring.reset(new IoUringPoller());
+		if (!_uring->init(4096)) {
+			mWarning() << "io_uring not available, fallback to epoll";
+			_uring.reset();
+		}
+		else {
+			_uringRecv = _uring->setupRecvBuffers(kRecvBufferCount, kRecvBufferSize);
+		}
+	}
+
+	addWakeupEvent();
+	addTimerFdEvent();
+
+	// epoll和唤醒fd就绪后再启动线程
 	if (!fromCurrentThread) {
 		_thread = std::thread(std::bind(&EventThread::runloop, this));
 		_selfThreadid = _thread.get_id();
@@ -69,76 +115,388 @@ EventThread::EventThread(bool fromCurrentThread) :_threadCancel(false) {
 		_selfThreadid = std::this_thread::get_id();
 		setThreadName(buf);
 	}
-
-    #ifdef _USE_EPOLL_
-    _epollfd = epoll_create(1);
-    if (_epollfd < 0) {
-        mCritical() << "epoll_create failed:" << strerror(errno);
-    }
-    #endif
-
-	addPipeEvent();
 }
 
-void DLNetwork::EventThread::addPipeEvent()
+void DLNetwork::EventThread::addWakeupEvent()
 {
-	SockUtil::setNoBlocked(_pipe.readFD());
-	SockUtil::setNoBlocked(_pipe.writeFD());
-	//addEvent(_pipe.readFD(), EventType::Read, [this](int fd, int event) {onPipeEvent(); });
-	Event ev{ _pipe.readFD(), EventType::Read, std::bind(&EventThread::onPipeEvent, this) };
-	_event_map.emplace(_pipe.readFD(), ev);
+	int fd = _notifier.readFD();
+	SockUtil::setNoBlocked(fd);
+	Event* ev = insertEvent(fd, EventType::Read, [this](int, int) { onWakeup(); });
+	if (_uring) {
+		uringArm(ev);
+		return;
+	}
 
 	#ifdef _USE_EPOLL_
 	struct epoll_event epev;
 	epev.events = 0; // 使用水平触发
 	epev.events |= EPOLLIN;
-	epev.data.fd = _pipe.readFD();
-	if(epoll_ctl(_epollfd, EPOLL_CTL_ADD, _pipe.readFD(), &epev) < 0) {
-		mCritical() << "EventThread::addPipeEvent epoll_ctl add failed:" << strerror(errno);
+	epev.data.ptr = ev;
+	if(epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &epev) < 0) {
+		mCritical() << "EventThread::addWakeupEvent epoll_ctl add failed:" << strerror(errno);
 	}
 	#endif
 
 }
 
-void EventThread::addEvent(int fd, int type, EventHandleFun && callback)
+void EventThread::addTimerFdEvent()
 {
-	if (isCurrentThread()) {
-		Event ev{ fd, type, callback };
-		_event_map.emplace(fd, ev);
-		
-		#ifdef _USE_EPOLL_
+	#ifdef HAVE_TIMERFD
+	_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (_timerFd < 0) {
+		mWarning() << "EventThread::addTimerFdEvent timerfd_create failed:" << strerror(errno);
+		return;
+	}
+	Event* ev = insertEvent(_timerFd, EventType::Read, [this](int, int) { onTimerFd(); });
+	if (_uring) {
+		uringArm(ev);
+		return;
+	}
+
+	struct epoll_event epev;
+	epev.events = EPOLLIN;
+	epev.data.ptr = ev;
+	if (epoll_ctl(_epollfd, EPOLL_CTL_ADD, _timerFd, &epev) < 0) {
+		mCritical() << "EventThread::addTimerFdEvent epoll_ctl add failed:" << strerror(errno);
+	}
+	#endif
+}
+
+EventThread::Event* EventThread::insertEvent(int fd, int type, EventHandleFun&& callback, const char* label)
+{
+	// 只用于唤醒fd、timerfd等loop自己的fd
+	Event* ev = new Event(fd, type, std::move(callback), label);
+	ev->internal = true;
+	return insertEvent(ev);
+}
+
+EventThread::Event* EventThread::insertEvent(Event* ev)
+{
+	int fd = ev->fd;
+	if ((size_t)fd >= _events.size()) {
+		_events.resize(std::max<size_t>(fd + 1, _events.size() * 2), nullptr);
+	}
+	_events[fd] = ev;
+	if (!ev->internal) {
+		_eventCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	ev->registered = ev->eventType;
+	return ev;
+}
+
+void EventThread::flushEventChanges()
+{
+	#ifdef _USE_EPOLL_
+	for (Event* ev : _dirtyEvents) {
+		ev->dirty = false;
+		if (ev->eventType == ev->registered) {
+			// 改了又改回来
+			continue;
+		}
 		struct epoll_event epev;
-		epev.events = 0; // 使用水平触发
-		if(type & EventType::Read) epev.events |= EPOLLIN;
-		if(type & EventType::Write) epev.events |= EPOLLOUT;
-		epev.data.fd = fd;
-		if(epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &epev) < 0) {
-			mCritical() << "EventThread::addEvent epoll_ctl add failed:" << strerror(errno);
+		epev.events = toEpollEvents(ev->eventType);
+		epev.data.ptr = ev;
+		if(epoll_ctl(_epollfd, EPOLL_CTL_MOD, ev->fd, &epev) < 0) {
+			mCritical() << "epoll_ctl mod failed:" << strerror(errno);
 		}
-		#endif
+		ev->registered = ev->eventType;
+	}
+	_dirtyEvents.clear();
+	#endif
+}
+
+void EventThread::freeRetiredEvents()
+{
+	for (Event* ev : _retiredEvents) {
+		delete ev;
+	}
+	_retiredEvents.clear();
+}
+
+// user_data: 高32位为请求序号(最高两位标记accept/recv请求)，低32位为fd
+static const uint64_t kUringAcceptTag = 1ULL << 63;
+static const uint64_t kUringRecvTag = 1ULL << 62;
+static const uint32_t kUringSeqMask = 0x3fffffff;
+
+static inline uint64_t uringUserData(uint32_t seq, int fd, bool accept)
+{
+	return ((uint64_t)seq << 32) | (accept ? kUringAcceptTag : 0) | (uint32_t)fd;
+}
+
+// 水平触发的事件用单次poll，每次回调后重新arm；边沿触发的用multishot poll
+// 监听socket用multishot accept，一个请求持续返回新连接
+// uringRecv的事件另有单次recv请求负责读，poll不等可读
+// 这些请求都只是写入提交队列，在waitUring时一起提交
+void EventThread::uringArm(Event* ev)
+{
+	ev->seq = ++_uringSeq & kUringSeqMask;
+	ev->armed = true;
+	uint64_t userData = uringUserData(ev->seq, ev->fd, ev->uringAccept);
+	if (ev->uringAccept) {
+		_uring->acceptMultishot(ev->fd, userData);
+		return;
+	}
+	int type = ev->eventType;
+	if (ev->uringRecv) {
+		uringArmRecv(ev);
+		// 不关注写时poll掩码为空，仍会报告错误和挂断(如MSG_ZEROCOPY的完成通知)
+		type &= ~EventType::Read;
+	}
+	_uring->pollAdd(ev->fd, ToPoll(type), (type & EventType::Edge) != 0, userData);
+}
+
+void EventThread::uringArmRecv(Event* ev)
+{
+	if (ev->recvArmed || !(ev->eventType & EventType::Read)) {
+		return;
+	}
+	ev->recvSeq = ++_uringSeq & kUringSeqMask;
+	ev->recvArmed = true;
+	_uring->recv(ev->fd, uringUserData(ev->recvSeq, ev->fd, false) | kUringRecvTag);
+}
+
+void EventThread::uringDisarm(Event* ev)
+{
+	if (ev->armed) {
+		uint64_t userData = uringUserData(ev->seq, ev->fd, ev->uringAccept);
+		if (ev->uringAccept) {
+			_uring->cancel(userData);
+		}
+		else {
+			_uring->pollRemove(userData);
+		}
+		ev->armed = false;
+	}
+	if (ev->recvArmed) {
+		_uring->cancel(uringUserData(ev->recvSeq, ev->fd, false) | kUringRecvTag);
+		ev->recvArmed = false;
+	}
+}
+
+int EventThread::waitUring(int timeout)
+{
+	uint64_t waitStart = monotonicNs();
+	int ret = _uring->submitAndWait(timeout);
+	_sleeping.store(false, std::memory_order_relaxed);
+	_wakeNs = monotonicNs();
+	_waitNs += _wakeNs - waitStart;
+	if (ret < 0) {
+		mWarning() << "EventThread::loopOnce io_uring_enter error:" << strerror(-ret);
+	}
+	return (int)_uring->forEachCompletion([this](uint64_t userData, int res, bool more, int bufId) {
+		onUringCompletion(userData, res, more, bufId);
+	});
+}
+
+void EventThread::onUringCompletion(uint64_t userData, int res, bool more, int bufId)
+{
+	if (userData == IoUringPoller::kInternalUserData) {
+		return;
+	}
+	int fd = (int)(uint32_t)userData;
+	uint32_t seq = (userData >> 32) & kUringSeqMask;
+	Event* ev = findEvent(fd);
+	if (userData & kUringRecvTag) {
+		// 旧请求的完成事件只归还缓冲区
+		onUringRecv(ev && ev->recvArmed && ev->recvSeq == seq ? ev : nullptr, fd, res, bufId);
+		return;
+	}
+	if (!ev || ev->seq != seq) {
+		// 已移除或已重新arm，是旧请求的完成事件
+		if ((userData & kUringAcceptTag) && res >= 0) {
+			// 撤销生效前内核已经accept的连接没有人接管
+			myclose(res);
+		}
+		return;
+	}
+	if (ev->uringAccept) {
+		onUringAccept(ev, res, more);
+		return;
+	}
+	if (!more) {
+		ev->armed = false;
+	}
+	if (res < 0) {
+		// 出错的请求不再自动arm，等modifyEvent/addEvent
+		mWarning() << "EventThread io_uring poll fd:" << fd << " error:" << strerror(-res);
+		return;
+	}
+	int eventType = (ToEventType(res)) & (ev->eventType | EventType::Error | EventType::Hangup);
+	if (ev->uringRecv) {
+		eventType &= ~EventType::Read;
+	}
+	if (eventType) {
+		invokeEvent(ev, fd, eventType);
+	}
+	// 回调中可能移除了事件，或者在同一fd上重新添加了
+	if (findEvent(fd) == ev && !ev->armed) {
+		uringArm(ev);
+	}
+}
+
+void EventThread::onUringAccept(Event* ev, int res, bool more)
+{
+	int fd = ev->fd;
+	if (!more) {
+		ev->armed = false;
+	}
+	if (res >= 0) {
+		ev->onAccept(fd, res);
+	}
+	else if (res == -EINVAL || res == -EOPNOTSUPP) {
+		// 内核不支持multishot accept，之后改用可读通知，与epoll下行为一致
+		mWarning() << "EventThread io_uring accept fd:" << fd << " error:" << strerror(-res) << ", fallback to poll";
+		if (ev->armed) {
+			uringDisarm(ev);
+		}
+		ev->uringAccept = false;
+	}
+	else {
+		// fd耗尽(EMFILE/ENFILE)、ENOBUFS、ECONNABORTED等暂时性错误，请求结束后重新提交multishot accept
+		mWarning() << "EventThread io_uring accept fd:" << fd << " error:" << strerror(-res);
+	}
+	if (findEvent(fd) == ev && !ev->armed) {
+		uringArm(ev);
+	}
+}
+
+void EventThread::onUringRecv(Event* ev, int fd, int res, int bufId)
+{
+	if (ev) {
+		ev->recvArmed = false;
+		// 接收缓冲区暂时用完等情况不通知调用方，下面重新提交
+		if (res != -ENOBUFS && res != -EINTR && res != -EAGAIN) {
+			const char* data = bufId >= 0 ? _uring->recvBuffer(bufId) : nullptr;
+			invokeTimed(ev, fd, [ev, data, res]() { ev->onRecv(data, res); });
+		}
+	}
+	if (bufId >= 0) {
+		_uring->recycleRecvBuffer(bufId);
+	}
+	// 回调中可能移除了事件或去掉了Read
+	if (ev && findEvent(fd) == ev) {
+		uringArmRecv(ev);
+	}
+}
+
+void EventThread::addEvent(int fd, int type, EventHandleFun && callback, const char* label)
+{
+	// Event反正要分配，在调用线程构造好，跨线程时任务只需捕获一个指针
+	std::unique_ptr<Event> ev(new Event(fd, type, std::move(callback), label));
+	if (isCurrentThread()) {
+		addEventInLoop(ev.release());
+	}
+	else {
+		dispatch([this, ev = std::move(ev)]() mutable {
+			addEventInLoop(ev.release());
+		});
+	}
+}
+
+void EventThread::addAcceptEvent(int listenFd, AcceptHandleFun&& callback, const char* label)
+{
+	std::unique_ptr<Event> ev(new Event(listenFd, EventType::Read, nullptr, label));
+	ev->onAccept = std::move(callback);
+	// 可读通知时自己accept，回调只在Event有效期间执行
+	Event* raw = ev.get();
+	ev->callback = [raw](int fd, int) {
+		int sock = (int)::accept(fd, nullptr, nullptr);
+		if (sock >= 0) {
+			raw->onAccept(fd, sock);
+		}
+	};
+	ev->uringAccept = _uring != nullptr;
+	if (isCurrentThread()) {
+		addEventInLoop(ev.release());
 	}
 	else {
-		dispatch([this, fd, type, callback]() {
-			addEvent(fd, type, std::move(const_cast<EventHandleFun &>(callback)));
+		dispatch([this, ev = std::move(ev)]() mutable {
+			addEventInLoop(ev.release());
 		});
 	}
 }
 
+void EventThread::addRecvEvent(int fd, int type, EventHandleFun&& callback, RecvHandleFun&& onRecv, const char* label)
+{
+	std::unique_ptr<Event> ev(new Event(fd, type, std::move(callback), label));
+	ev->onRecv = std::move(onRecv);
+	ev->uringRecv = _uringRecv;
+	if (isCurrentThread()) {
+		addEventInLoop(ev.release());
+	}
+	else {
+		dispatch([this, ev = std::move(ev)]() mutable {
+			addEventInLoop(ev.release());
+		});
+	}
+}
+
+void EventThread::addEventInLoop(Event* ev)
+{
+	int fd = ev->fd;
+	if (findEvent(fd)) {
+		mCritical() << "EventThread::addEvent fd already added:" << fd;
+		delete ev;
+		return;
+	}
+	if (_soBusyPollUs > 0) {
+		SockUtil::setBusyPoll(fd, _soBusyPollUs);
+	}
+	insertEvent(ev);
+	if (_uring) {
+		uringArm(ev);
+		return;
+	}
+
+	#ifdef _USE_EPOLL_
+	struct epoll_event epev;
+	epev.events = toEpollEvents(ev->eventType); // 默认水平触发，带EventType::Edge时边沿触发
+	epev.data.ptr = ev;
+	if(epoll_ctl(_epollfd, EPOLL_CTL_ADD, fd, &epev) < 0) {
+		mCritical() << "EventThread::addEvent epoll_ctl add failed:" << strerror(errno);
+	}
+	#endif
+}
+
 void EventThread::modifyEvent(int fd, int type)
 {
 	if (isCurrentThread()) {
-		auto it = _event_map.find(fd);
-		if (it != _event_map.end()) {
-			it->second.eventType = type;
+		Event* ev = findEvent(fd);
+		if (ev) {
+			if (_uring) {
+				if (ev->eventType == type) {
+					return;
+				}
+				if (ev->uringRecv) {
+					// 读由recv负责，只有写或触发方式变了才重新提交poll；
+					// 进行中的recv不撤销，暂停读之前提交的recv带回的数据照常交给onRecv
+					int changed = ev->eventType ^ type;
+					ev->eventType = type;
+					if (ev->armed && (changed & (EventType::Write | EventType::Edge))) {
+						_uring->pollRemove(uringUserData(ev->seq, fd, false));
+						ev->armed = false;
+						uringArm(ev);
+					}
+					else {
+						uringArmRecv(ev);
+					}
+					return;
+				}
+				ev->eventType = type;
+				// 回调执行中(未arm)的事件在回调返回后按新的type重新arm
+				if (ev->armed) {
+					uringDisarm(ev);
+					uringArm(ev);
+				}
+				return;
+			}
+			ev->eventType = type;
 			
 			#ifdef _USE_EPOLL_
-			struct epoll_event epev;
-			epev.events = 0;
-			if(type & EventType::Read) epev.events |= EPOLLIN;
-			if(type & EventType::Write) epev.events |= EPOLLOUT;
-			epev.data.fd = fd;
-			if(epoll_ctl(_epollfd, EPOLL_CTL_MOD, fd, &epev) < 0) {
-				mCritical() << "epoll_ctl mod failed:" << strerror(errno);
+			// 不立即epoll_ctl，同一轮的多次修改在下次epoll_wait前合并成一次，与内核中相同则跳过
+			if (!ev->dirty && type != ev->registered) {
+				ev->dirty = true;
+				_dirtyEvents.push_back(ev);
 			}
 			#endif
 		}
@@ -153,7 +511,26 @@ void EventThread::modifyEvent(int fd, int type)
 void EventThread::removeEvents(int fd)
 {
 	if (isCurrentThread()) {
-		_event_map.erase(fd);
+		Event* ev = findEvent(fd);
+		if (ev) {
+			if (_uring) {
+				uringDisarm(ev);
+			}
+			if (ev->dirty) {
+				_dirtyEvents.erase(std::find(_dirtyEvents.begin(), _dirtyEvents.end(), ev));
+				ev->dirty = false;
+			}
+			// epoll本批次返回的事件可能还指向它，先标记失效，本轮结束再释放
+			ev->fd = -1;
+			_events[fd] = nullptr;
+			if (!ev->internal) {
+				_eventCount.fetch_sub(1, std::memory_order_relaxed);
+			}
+			_retiredEvents.push_back(ev);
+		}
+		if (_uring) {
+			return;
+		}
 		
 		#ifdef _USE_EPOLL_
 		struct epoll_event epev;
@@ -174,100 +551,306 @@ void EventThread::dispatch(TASK_FUN &&task, bool insertFront, bool tryNoQueue) {
 		return task();
 	}
 
-    {
-	    std::lock_guard<std::mutex> lock(_taskMutex);
-	    if (insertFront) {
-		    _taskQueue.emplace_front(task);
-	    }
-	    else {
-		    _taskQueue.emplace_back(task);
-	    }
-    }
-	//写数据到管道,唤醒主线程
-	_pipe.write("", 1);
+	_pendingTasks.fetch_add(1);
+	QueuedTask queued{ std::move(task), _statsEnabled.load(std::memory_order_relaxed) ? monotonicNs() : 0 };
+	if (insertFront) {
+		_frontTaskQueue.push(std::move(queued));
+	}
+	else {
+		_taskQueue.push(std::move(queued));
+	}
+	// loop醒着时会在本轮末尾执行任务，无需系统调用；阻塞中才唤醒，且合并为一次
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (_sleeping.load(std::memory_order_relaxed) && !_wakeupPending.exchange(true)) {
+		_notifier.notify();
+	}
 	return;
 }
 
-Timer* EventThread::addTimer(unsigned int ms, Timer::TIMER_FUN task, void* arg) {
+void EventThread::setBusyPoll(unsigned int spinUs, int soBusyPollUs) {
+	if (isCurrentThread()) {
+		_busyPollUs = spinUs;
+		_soBusyPollUs = soBusyPollUs;
+	}
+	else {
+		dispatch([this, spinUs, soBusyPollUs]() {
+			setBusyPoll(spinUs, soBusyPollUs);
+		});
+	}
+}
+
+bool EventThread::setCpuAffinity(int cpu) {
+	if (_thread.joinable()) {
+		return setThreadAffinity(&_thread, cpu);
+	}
+	return setThreadAffinity(cpu);
+}
+
+bool EventThread::setCpuAffinity(const std::vector<int>& cpus) {
+	if (cpus.size() == 1) {
+		return setCpuAffinity(cpus[0]);
+	}
+	return _thread.joinable() && setThreadAffinity(&_thread, cpus);
+}
+
+void EventThread::setMemoryNode(int node) {
+	// mempolicy是线程级的，必须在loop线程里设置
+	dispatch([this, node]() {
+		if (CpuTopology::preferMemoryNode(node)) {
+			_memoryNode = node;
+		}
+		else {
+			mWarning() << "EventThread::setMemoryNode failed, node:" << node;
+		}
+	}, false, true);
+}
+
+TimerId EventThread::addTimer(unsigned int ms, Timer::TIMER_FUN task, void* arg) {
 	if (isCurrentThread()) {
 		return addTimerInLoop(ms, std::move(task), arg);
 	}
 	else {
-		Timer* timer = new Timer(ms, std::move(task), arg);
-		dispatch([this, timer]() {
-			_timerMan.addTimer(timer);
+		Timer* timer = new Timer(0, std::move(task), arg);
+		dispatch([this, timer, ms]() {
+			_timerMan.addTimer(timer, ms);
 		});
-		return timer;
+		return TimerId(timer);
 	}
 }
 
-Timer* EventThread::addTimerInLoop(unsigned int ms, Timer::TIMER_FUN task, void* arg) {
+TimerId EventThread::addTimerInLoop(unsigned int ms, Timer::TIMER_FUN task, void* arg) {
 	assert(isCurrentThread());
 	return _timerMan.addTimer(ms, std::move(task), arg);
 }
 
-bool EventThread::delTimerInLoop(Timer* t) {
+bool EventThread::delTimerInLoop(TimerId id) {
 	assert(isCurrentThread());
-	return _timerMan.delTimer(t);
+	return _timerMan.delTimer(id);
 }
 
-void EventThread::delTimer(Timer* t) {
+void EventThread::delTimer(TimerId id) {
+	if (!id) {
+		return;
+	}
 	if (isCurrentThread()) {
-		delTimerInLoop(t);
+		delTimerInLoop(id);
 	}
 	else {
-		t->cancel();
-		//bool done = false;
-		dispatch([this, t]() {
-			delTimerInLoop(t);
-			//std::unique_lock<std::mutex> lock(_timerMutex);
-			//done = true;
-			//lock.unlock();
-			//_timerCV.notify_all();
-			});
-		// std::unique_lock<std::mutex> lk(_timerMutex);
-		// _timerCV.wait(lk, [this, &done] {return done; });
+		// Timer对象在TimerManager析构前不会释放，带序号cancel即使已被复用也不会影响新的timer
+		id.timer->cancel(id.seq);
+		dispatch([this, id]() {
+			delTimerInLoop(id);
+		});
+	}
+}
+
+bool EventThread::resetTimer(TimerId id, unsigned int ms) {
+	if (isCurrentThread()) {
+		return _timerMan.resetTimer(id, ms);
 	}
+	dispatch([this, id, ms]() {
+		_timerMan.resetTimer(id, ms);
+	});
+	// 是否重置成功要等loop线程执行后才知道
+	return false;
+}
+
+TimerId EventThread::addTimer(std::chrono::microseconds us, Timer::TIMER_FUN task, void* arg) {
+	if (isCurrentThread()) {
+		return _timerMan.addTimer(us, std::move(task), arg);
+	}
+	Timer* timer = new Timer(0, std::move(task), arg);
+	dispatch([this, timer, us]() {
+		_timerMan.addTimer(timer, us);
+	});
+	return TimerId(timer);
+}
+
+bool EventThread::resetTimer(TimerId id, std::chrono::microseconds us) {
+	if (isCurrentThread()) {
+		return _timerMan.resetTimer(id, us);
+	}
+	dispatch([this, id, us]() {
+		_timerMan.resetTimer(id, us);
+	});
+	// 是否重置成功要等loop线程执行后才知道
+	return false;
 }
 
 void EventThread::delay(unsigned int ms, Timer::TIMER_FUN && task, void* arg)
 {
-	dispatch([this, ms, task, arg]() {
-		addTimerInLoop(ms, task, arg);
+	// 同跨线程的addTimer，先构造好Timer，任务只捕获指针
+	Timer* timer = new Timer(0, std::move(task), arg);
+	dispatch([this, timer, ms]() {
+		_timerMan.addTimer(timer, ms);
 		//uint64_t now = getCurrentMicrosecondEpoch();
 		//_delayTask.emplace(ms+now, task);
 	}, true);
 }
 
-void EventThread::onPipeEvent() {
-	char buf[1024];
-	int err = 0;
-	do {
-		int ret = _pipe.read(buf, sizeof(buf));
-		if (ret > 0) {
-			continue;
+void EventThread::onWakeup() {
+	_wakeupPending.store(false);
+	if (!_notifier.drain()) {
+		mWarning() << "EventThread::onWakeup notifier broken, reopen";
+		removeEvents(_notifier.readFD());
+		_notifier.reOpen();
+		addWakeupEvent();
+	}
+}
+
+void EventThread::onTimerFd() {
+	#ifdef HAVE_TIMERFD
+	uint64_t expirations;
+	while (read(_timerFd, &expirations, sizeof(expirations)) > 0) {
+	}
+	// 已触发，下次无论到期时间是否相同都要重新设定
+	_timerFdExpire = 0;
+	#endif
+	// 到期的timer在下一轮loopOnce开头统一执行
+}
+
+void EventThread::armTimerFd() {
+	#ifdef HAVE_TIMERFD
+	if (_timerFd < 0) {
+		return;
+	}
+	unsigned long long expire = _timerMan.nextPreciseExpire();
+	if (expire == _timerFdExpire) {
+		return;
+	}
+	// TimerManager用steady_clock，Linux下即CLOCK_MONOTONIC，可以直接设绝对时间；expire为0时停用
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = expire / 1000000;
+	its.it_value.tv_nsec = (expire % 1000000) * 1000;
+	if (timerfd_settime(_timerFd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		mWarning() << "EventThread::armTimerFd timerfd_settime failed:" << strerror(errno);
+		return;
+	}
+	_timerFdExpire = expire;
+	#endif
+}
+
+bool EventThread::hasPendingTasks() {
+	return _pendingTasks.load() != 0;
+}
+
+void EventThread::runTasks() {
+	// 只执行本轮开始时已入队的任务，任务中再dispatch的留到下一轮
+	size_t budget = _pendingTasks.load(std::memory_order_acquire);
+	if (budget == 0) {
+		return;
+	}
+	if (_statsEnabled.load(std::memory_order_relaxed)) {
+		_stats.queueDepth.record(budget);
+	}
+	size_t done = 0;
+	QueuedTask task;
+	// insertFront的任务先执行，且与插入链表头的语义一致：后插入的先执行
+	while (done < budget && _frontTaskQueue.pop(task)) {
+		_frontBatch.emplace_back(std::move(task));
+		done++;
+	}
+	if (!_frontBatch.empty()) {
+		_pendingTasks.fetch_sub(_frontBatch.size(), std::memory_order_relaxed);
+		for (auto it = _frontBatch.rbegin(); it != _frontBatch.rend(); ++it) {
+			runTask(*it);
 		}
-		err = get_uv_error(true);
-		if (ret == 0 || err != UV_EAGAIN) {
-            //对端关闭
-            mWarning() << "EventThread::onPipeEvent pipe closed";
-			removeEvents(_pipe.readFD());
-			_pipe.reOpen();
-			addPipeEvent();
+		_frontBatch.clear();
+	}
+	while (done < budget && _taskQueue.pop(task)) {
+		done++;
+		_pendingTasks.fetch_sub(1, std::memory_order_relaxed);
+		runTask(task);
+	}
+}
+
+void EventThread::runTask(QueuedTask& task) {
+	if (task.enqueueNs == 0 || !_statsEnabled.load(std::memory_order_relaxed)) {
+		task.fn();
+		return;
+	}
+	uint64_t start = monotonicNs();
+	_stats.queueDelayUs.record((start - task.enqueueNs) / 1000);
+	const char* label = task.fn.target_type().name();
+	_callbackLabel.store(label, std::memory_order_relaxed);
+	_callbackStartNs.store(start, std::memory_order_relaxed);
+	task.fn();
+	uint64_t cost = (monotonicNs() - start) / 1000;
+	_callbackStartNs.store(0, std::memory_order_relaxed);
+	_stats.taskUs.record(cost);
+	recordCost(SlowKind::Task, -1, label, cost);
+}
+
+void EventThread::invokeEvent(Event* ev, int fd, int eventType) {
+	invokeTimed(ev, fd, [ev, fd, eventType]() { ev->callback(fd, eventType); });
+}
+
+template<typename F>
+void EventThread::invokeTimed(Event* ev, int fd, F&& call) {
+	if (!_statsEnabled.load(std::memory_order_relaxed)) {
+		call();
+		return;
+	}
+	uint64_t start = monotonicNs();
+	_stats.dispatchDelayUs.record((start - _wakeNs) / 1000);
+	// 回调中可能移除自身，先取出label
+	const char* label = ev->label ? ev->label : ev->callback.target_type().name();
+	_callbackLabel.store(label, std::memory_order_relaxed);
+	_callbackStartNs.store(start, std::memory_order_relaxed);
+	call();
+	uint64_t cost = (monotonicNs() - start) / 1000;
+	_callbackStartNs.store(0, std::memory_order_relaxed);
+	_stats.callbackUs.record(cost);
+	recordCost(SlowKind::Event, fd, label, cost);
+}
+
+void EventThread::recordCost(SlowKind kind, int fd, const char* label, uint64_t costUs) {
+	_stats.recordSlow(kind, fd, label, costUs);
+	if (costUs < _stallUs.load(std::memory_order_relaxed)) {
+		return;
+	}
+	_stats.stalls.fetch_add(1, std::memory_order_relaxed);
+	// 持续卡顿时每秒最多告警一次
+	uint64_t nowMs = monotonicNs() / 1000000;
+	if (nowMs - _lastStallLogMs >= 1000) {
+		_lastStallLogMs = nowMs;
+		static const char* kinds[] = { "event", "task", "timer" };
+		mWarning() << "EventThread" << this << "stall" << kinds[(int)kind] << "fd:" << fd << "cost:" << costUs / 1000 << "ms"
+			<< LoopStats::demangle(label);
+	}
+}
+
+void EventThread::setStatsEnabled(bool on, unsigned int stallMs) {
+	_stallUs.store((uint64_t)stallMs * 1000, std::memory_order_relaxed);
+	_statsEnabled.store(on, std::memory_order_relaxed);
+	// TimerManager只能在loop线程访问
+	dispatch([this, on]() {
+		if (!on) {
+			_timerMan.setRunHook(nullptr);
+			return;
 		}
-		break;
-	} while (true);
+		_timerMan.setRunHook([this](Timer* t, unsigned long long lateUs, unsigned long long costUs) {
+			_stats.timerLateUs.record(lateUs);
+			_stats.timerUs.record(costUs);
+			recordCost(SlowKind::Timer, -1, t->targetType().name(), costUs);
+		});
+	}, false, true);
+}
 
-	std::list<TASK_FUN> tmp;
-	std::unique_lock<std::mutex> lk(_taskMutex);
-	_taskQueue.swap(tmp);
-	//TASK_FUN task = std::move(_taskQueue.front());
-	//_taskQueue.pop_front();
-	lk.unlock();
+void EventThread::resetStats() {
+	dispatch([this]() {
+		_stats.reset();
+	}, false, true);
+}
 
-	for (auto& task : tmp) {
-		task();
+uint64_t EventThread::currentCallbackUs() const {
+	uint64_t start = _callbackStartNs.load(std::memory_order_relaxed);
+	if (start == 0) {
+		return 0;
 	}
+	uint64_t now = monotonicNs();
+	return now > start ? (now - start) / 1000 : 0;
 }
 
 //uint64_t EventThread::processExpireTasks()
@@ -298,55 +881,114 @@ void EventThread::onPipeEvent() {
 void EventThread::loopOnce()
 {
 	//uint64_t nextDelay = processExpireTasks();
-	uint64_t nextDelay = _timerMan.processAllTimeout();
+	uint64_t nextDelay = _timerMan.processAllTimeout(); // ms
+	armTimerFd();
+	updateLoad();
 
-	if (_event_map.size() == 0) {
-		return;
+	// 低延迟模式下先空转轮询，期间不阻塞也不需要被唤醒
+	if (_busyPollUs == 0 || hasPendingTasks() || !busyPoll()) {
+		// 先声明即将阻塞，再检查任务队列；与dispatch中的先入队再检查_sleeping配对，保证不丢唤醒
+		_sleeping.store(true);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		int timeout = nextDelay ? (int)std::min<uint64_t>(nextDelay, 10000) : 10000;
+		if (hasPendingTasks()) {
+			timeout = 0;
+		}
+		pollEvents(timeout);
+	}
+
+	runTasks();
+	freeRetiredEvents();
+}
+
+bool EventThread::busyPoll()
+{
+	unsigned long long now = _timerMan.getCurrentMicrosecs();
+	unsigned long long deadline = now + _busyPollUs;
+	// 不空转过下一个timer的到期时间
+	unsigned long long timerExpire = _timerMan.nextPreciseExpire();
+	if (timerExpire && timerExpire < deadline) {
+		deadline = timerExpire;
+	}
+	unsigned long long recent = _timerMan.getRecentTimeout(); // ms，没有timer时为-1
+	if (recent != (unsigned long long)-1 && now + recent * 1000 < deadline) {
+		deadline = now + recent * 1000;
+	}
+	do {
+		if (pollEvents(0) > 0 || hasPendingTasks()) {
+			return true;
+		}
+		now = _timerMan.getCurrentMicrosecs();
+	} while (now < deadline);
+	return false;
+}
+
+int EventThread::pollEvents(int timeout)
+{
+	if (_uring) {
+		return waitUring(timeout);
 	}
 
 	#ifdef _USE_EPOLL_
-	const int MAX_EVENTS = 10;
-	struct epoll_event events[MAX_EVENTS];
+	flushEventChanges();
+	int maxEvents = std::min((int)_epollEvents.size(), _maxEvents);
+	struct epoll_event* events = _epollEvents.data();
 	
-	int ret = epoll_wait(_epollfd, events, MAX_EVENTS, nextDelay?nextDelay/1000:10000);
+	uint64_t waitStart = monotonicNs();
+	int ret = epoll_wait(_epollfd, events, maxEvents, timeout);
+	_sleeping.store(false, std::memory_order_relaxed);
+	_wakeNs = monotonicNs();
+	_waitNs += _wakeNs - waitStart;
 	
 	if (ret > 0) {
 		for (int i = 0; i < ret; i++) {
-			int fd = events[i].data.fd;
-			auto iter = _event_map.find(fd);
-			if (iter != _event_map.end()) {
-				int eventType = 0;
-				if(events[i].events & EPOLLIN) eventType |= EventType::Read;
-				if(events[i].events & EPOLLOUT) eventType |= EventType::Write;
-				if(events[i].events & EPOLLERR) eventType |= EventType::Error;
-				if(events[i].events & EPOLLHUP) eventType |= EventType::Hangup;
-				
-				iter->second.callback(fd, eventType);
+			Event* ev = static_cast<Event*>(events[i].data.ptr);
+			if (ev->fd < 0) {
+				// 本批次中已被前面的回调移除
+				continue;
 			}
+			int eventType = 0;
+			if(events[i].events & EPOLLIN) eventType |= EventType::Read;
+			if(events[i].events & EPOLLOUT) eventType |= EventType::Write;
+			if(events[i].events & EPOLLERR) eventType |= EventType::Error;
+			if(events[i].events & EPOLLHUP) eventType |= EventType::Hangup;
+			
+			invokeEvent(ev, ev->fd, eventType);
+		}
+		// 一批取满说明还有积压，扩大下次的批次
+		if (ret == maxEvents && maxEvents < _maxEvents) {
+			_epollEvents.resize(std::min(maxEvents * 2, _maxEvents));
 		}
 	}
-	else if (ret < 0) {
+	else if (ret < 0 && errno != EINTR) {
 		mWarning() << "EventThread::loopOnce epoll_wait error:" << strerror(errno);
 	}
+	return ret;
 	
 	#else
-	_pollfds.resize(_event_map.size());
-	int i = 0;
-	for (auto& evpair: _event_map) {
-		_pollfds[i].fd = evpair.first;
-		_pollfds[i].events = ToPoll(evpair.second.eventType);
-		_pollfds[i].revents = 0;
-		i++;
+	_pollfds.clear();
+	_pollEvents.clear();
+	for (Event* ev : _events) {
+		if (ev) {
+			struct pollfd pfd;
+			pfd.fd = ev->fd;
+			pfd.events = ToPoll(ev->eventType);
+			pfd.revents = 0;
+			_pollfds.push_back(pfd);
+			_pollEvents.push_back(ev);
+		}
 	}
 
-	int ret = poll(_pollfds.data(), _pollfds.size(), nextDelay?nextDelay/1000:10000);
+	uint64_t waitStart = monotonicNs();
+	int ret = poll(_pollfds.data(), _pollfds.size(), timeout);
+	_sleeping.store(false, std::memory_order_relaxed);
+	_wakeNs = monotonicNs();
+	_waitNs += _wakeNs - waitStart;
 	if (ret > 0) {
 		for (size_t i = 0; i < _pollfds.size(); i++) {
-			if (_pollfds[i].revents != 0) {
-				auto iter = _event_map.find(_pollfds[i].fd);
-				if (iter != _event_map.end()) {
-					iter->second.callback(_pollfds[i].fd, ToEventType(_pollfds[i].revents));
-				}
+			Event* ev = _pollEvents[i];
+			if (_pollfds[i].revents != 0 && ev->fd >= 0) {
+				invokeEvent(ev, ev->fd, ToEventType(_pollfds[i].revents));
 			}
 		}
 	}
@@ -358,29 +1000,85 @@ void EventThread::loopOnce()
 		//mWarning() << "EventThread::loopOnce poll error:" << myerrno;
 		//timeout
 	}
+	return ret;
 	#endif
 }
 
+void EventThread::updateLoad()
+{
+	uint64_t now = monotonicNs();
+	if (_loadWindowStart == 0) {
+		_loadWindowStart = now;
+		return;
+	}
+	uint64_t elapsed = now - _loadWindowStart;
+	if (elapsed < kLoadWindowNs) {
+		return;
+	}
+	uint64_t busy = elapsed > _waitNs ? elapsed - _waitNs : 0;
+	uint32_t permille = (uint32_t)(busy * 1000 / elapsed);
+	// 与上一窗口平均，避免单个窗口的抖动
+	_busyPermille.store((_busyPermille.load(std::memory_order_relaxed) + permille) / 2, std::memory_order_relaxed);
+	_bytesPerSec.store(_ioBytes * 1000000000ULL / elapsed, std::memory_order_relaxed);
+	_loadWindowStart = now;
+	_waitNs = 0;
+	_ioBytes = 0;
+}
+
+ThreadLoad EventThread::load() const
+{
+	ThreadLoad load;
+	load.fds = eventCount();
+	load.busyRatio = _busyPermille.load(std::memory_order_relaxed) / 1000.0;
+	load.bytesPerSec = _bytesPerSec.load(std::memory_order_relaxed);
+	load.pendingTasks = _pendingTasks.load(std::memory_order_relaxed);
+	return load;
+}
+
 void EventThread::runloop()
 {
+	BufferPool::setCurrent(&_bufferPool);
 	while (!_threadCancel) {
 		_checkTime = time(NULL);
-		if (_event_map.size() == 0) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(20));
-			continue;
-		}
+		// 没有用户fd时同样阻塞在唤醒fd上，任务和timer照常处理
 		loopOnce();
 	}
+	BufferPool::setCurrent(nullptr);
+}
+
+void EventThreadPool::init(int poolSize, IoBackend backend)
+{
+	EventThreadPoolConfig config;
+	config.poolSize = poolSize;
+	config.backend = backend;
+	init(config);
 }
 
-void EventThreadPool::init(int poolSize)
+void EventThreadPool::init(const EventThreadPoolConfig& config)
 {
-	_threads.reserve(poolSize);
-	for (size_t i = 0; i < poolSize; i++) {
-		EventThread *t = new EventThread();
+	std::vector<std::vector<int>> cpuSets = config.cpuSets;
+	if (cpuSets.empty() && config.autoAffinity) {
+		cpuSets = CpuTopology::spread(config.poolSize);
+	}
+	_threads.reserve(config.poolSize);
+	for (int i = 0; i < config.poolSize; i++) {
+		EventThread *t = new EventThread(false, config.backend);
 		_threads.push_back(t);
+		if (cpuSets.empty()) {
+			continue;
+		}
+		auto& cpus = cpuSets[i % cpuSets.size()];
+		if (cpus.empty()) {
+			continue;
+		}
+		if (!t->setCpuAffinity(cpus)) {
+			mWarning() << "EventThreadPool::init set cpu affinity failed, thread:" << i;
+		}
+		if (config.numaLocal) {
+			t->setMemoryNode(CpuTopology::nodeOfCpu(cpus[0]));
+		}
 	}
-    _debugThread = new EventThread();
+    _debugThread = new EventThread(false, config.backend);
 	std::thread t(&EventThreadPool::runloop, this);
 	t.detach();
 }
@@ -409,15 +1107,58 @@ EventThreadPool& EventThreadPool::instance()
 
 EventThread * EventThreadPool::getIdlestThread()
 {
-	int minCount = _threads[0]->eventCount();
-	EventThread *ret = _threads[0];
-	for (auto t : _threads) {
-		if (t->eventCount() < minCount) {
-			minCount = t->eventCount();
-			ret = t;
+	return pickThread(_policy);
+}
+
+double EventThreadPool::loadScore(EventThread* thread) const
+{
+	ThreadLoad load = thread->load();
+	if (_scorer) {
+		return _scorer(load);
+	}
+	return load.busyRatio * 100 + load.pendingTasks * 0.1 + load.fds * 0.01 + load.bytesPerSec / 1e7;
+}
+
+EventThread* EventThreadPool::pickThread(PlacementPolicy policy)
+{
+	if (_threads.size() < 2) {
+		return _threads.empty() ? nullptr : _threads[0];
+	}
+	switch (policy) {
+	case PlacementPolicy::PowerOfTwoChoices: {
+		// 只比较两个随机线程，各线程的负载统计有延迟时也不会让连接集中涌向同一个线程
+		thread_local std::minstd_rand rng(std::random_device{}());
+		size_t a = rng() % _threads.size();
+		size_t b = rng() % (_threads.size() - 1);
+		if (b >= a) {
+			b++;
 		}
+		return loadScore(_threads[a]) <= loadScore(_threads[b]) ? _threads[a] : _threads[b];
+	}
+	case PlacementPolicy::LeastLoaded: {
+		EventThread* ret = _threads[0];
+		double minScore = loadScore(ret);
+		for (auto t : _threads) {
+			double score = loadScore(t);
+			if (score < minScore) {
+				minScore = score;
+				ret = t;
+			}
+		}
+		return ret;
+	}
+	default: {
+		int minCount = _threads[0]->eventCount();
+		EventThread *ret = _threads[0];
+		for (auto t : _threads) {
+			if (t->eventCount() < minCount) {
+				minCount = t->eventCount();
+				ret = t;
+			}
+		}
+		return ret;
+	}
 	}
-	return ret;
 }
 
 void DLNetwork::EventThreadPool::runloop()
@@ -431,6 +1172,11 @@ void DLNetwork::EventThreadPool::runloop()
 					mWarning() << "eventThread" << t << "blocked! checktime" << t->_checkTime << "block time" << delta;
 				}
 			}
+			// 开启统计时可以知道卡在哪个回调里
+			uint64_t us = t->currentCallbackUs();
+			if (us >= 1000000) {
+				mWarning() << "eventThread" << t << "stuck in callback" << LoopStats::demangle(t->currentCallbackLabel()) << us / 1000 << "ms";
+			}
 		}
 		std::this_thread::sleep_for(std::chrono::milliseconds(2000));
 	}
@@ -439,6 +1185,7 @@ void DLNetwork::EventThreadPool::runloop()
 EventThread::~EventThread() {
     if (!_threadCancel) {
         _threadCancel = true;
+        _notifier.notify();
         _thread.join();
     }
     #if defined(_USE_EPOLL_)
@@ -450,4 +1197,13 @@ EventThread::~EventThread() {
         epoll_close(_epollfd);
     }
     #endif
+    #ifdef HAVE_TIMERFD
+    if (_timerFd >= 0) {
+        close(_timerFd);
+    }
+    #endif
+    for (Event* ev : _events) {
+        delete ev;
+    }
+    freeRetiredEvents();
 };
@@ -32,10 +32,22 @@
 #include <unordered_map>
 #include <assert.h>
 #include <condition_variable>
-#include "PipeWrap.h"
+#include <atomic>
+#include <memory>
+#include "EventNotifier.h"
+#include "IoUringPoller.h"
 #include "TimerManager.h"
+#include "SmallFunction.h"
+#include "MpscQueue.h"
+#include "DispatchQueue.h"
+#include "LoopStats.h"
+#include "BufferPool.h"
 #include <time.h>
 
+#ifdef _USE_EPOLL_
+struct epoll_event;
+#endif
+
 namespace DLNetwork {
 
 enum EventType :int {
@@ -44,19 +56,67 @@ enum EventType :int {
 	Read = 1 << 2,
 	Write = 1 << 3,
 	ALL = Read | Write | Error | Hangup,
+	Edge = 1 << 4, // 边沿触发注册标志(仅epoll)，不会出现在回调的eventType中
+};
+using EventHandleFun = SmallFunction<void(int, int)>;
+using AcceptHandleFun = SmallFunction<void(int listenFd, int newFd)>;
+using RecvHandleFun = SmallFunction<void(const char* data, int len)>;
+
+// 线程负载，由loop线程按统计窗口发布，其他线程可随时读取
+struct ThreadLoad {
+	int fds;              // 注册的用户fd数，不含loop内部的唤醒fd和timerfd
+	double busyRatio;     // 最近窗口内loop不在等待事件的时间占比，0~1
+	uint64_t bytesPerSec; // 最近窗口内Connection的收发速率
+	size_t pendingTasks;  // 已dispatch未执行的任务数
+};
+
+enum class PlacementPolicy {
+	LeastFds,          // fd最少的线程
+	LeastLoaded,       // 负载分最低的线程，需要读所有线程的负载
+	PowerOfTwoChoices, // 随机取两个线程，选负载分低的
+};
+
+enum class IoBackend {
+	Epoll,   // 未定义_USE_EPOLL_时为poll
+	IoUring, // io_uring poll，监听socket用multishot accept；内核不支持时回退到Epoll
 };
-using EventHandleFun = std::function<void(int, int)>;
 
 class EventThread
 {
-	using TASK_FUN = std::function<void(void)>;
+	using TASK_FUN = SmallFunction<void(void)>;
 	//using TIMER_FUN = std::function<int(void)>; // return next trigger timeout in ms. return 0 means don't trigger again.
 
 	struct Event
 	{
+		Event(int fd, int type, EventHandleFun&& callback, const char* label)
+			: fd(fd), eventType(type), callback(std::move(callback)), label(label) {}
+
 		int fd;
 		int eventType;
 		EventHandleFun callback;
+		// io_uring: 当前poll请求的序号，编进user_data用来丢弃已撤销请求的完成事件
+		uint32_t seq = 0;
+		bool armed = false;
+		const char* label = nullptr; // 统计中标识慢回调的来源，如会话类型
+		// epoll: 已注册到内核的type，与eventType不同时在下次epoll_wait前统一epoll_ctl
+		int registered = 0;
+		bool dirty = false; // 已在_dirtyEvents中
+		// 监听socket有新连接时的回调，uringAccept时由io_uring multishot accept直接返回新fd
+		AcceptHandleFun onAccept;
+		bool uringAccept = false;
+		// uringRecv时读由单独的recv请求完成，数据交给onRecv，poll请求只等写和错误
+		RecvHandleFun onRecv;
+		bool uringRecv = false;
+		uint32_t recvSeq = 0;
+		bool recvArmed = false;
+		// loop自己的唤醒fd、timerfd，不计入eventCount
+		bool internal = false;
+	};
+
+	struct QueuedTask
+	{
+		TASK_FUN fn;
+		uint64_t enqueueNs; // 开启统计时的入队时间，否则为0
 	};
 
 public:
@@ -65,39 +125,178 @@ public:
 	//	return new EventThread(true);
 	//}
 	~EventThread();
-	void addPipeEvent();
-	void addEvent(int fd, int type, EventHandleFun&& callback);
+	void addWakeupEvent();
+	void addTimerFdEvent();
+	// label需长期有效(如字面量、type_info::name())，统计慢回调时用来标识来源
+	void addEvent(int fd, int type, EventHandleFun&& callback, const char* label = nullptr);
+	// 监听socket上有新连接时以新连接的fd调用callback，用removeEvents移除
+	// io_uring后端用完成模式的multishot accept，内核直接完成accept后返回新fd；
+	// 其他后端，或内核不支持(5.19以下)、accept出错时，退回可读通知后自己accept
+	void addAcceptEvent(int listenFd, AcceptHandleFun&& callback, const char* label = nullptr);
+	// 同addEvent，但io_uring后端且内核支持provided buffer ring(5.19以上)时，callback不再收到Read，
+	// 而是由loop提交recv，内核把数据读进线程的接收缓冲区后调用onRecv(data, len)，data只在回调期间有效。
+	// len为0表示对端关闭，<0为负的错误码，之后调用方应移除事件。recv请求与其他请求在一轮loop中批量提交。
+	// 去掉Read后不再提交新的recv，已提交的recv带回的数据仍会交给onRecv
+	void addRecvEvent(int fd, int type, EventHandleFun&& callback, RecvHandleFun&& onRecv, const char* label = nullptr);
 	void modifyEvent(int fd, int type);
 	void removeEvents(int fd);
-	int eventCount() { return _event_map.size(); }
+	// 注册的用户fd数，不含loop内部的唤醒fd和timerfd
+	int eventCount() const { return (int)_eventCount.load(std::memory_order_relaxed); }
+	ThreadLoad load() const;
+	// 只能在loop线程中调用，累计收发字节数用于负载统计
+	void addIoBytes(size_t n) { _ioBytes += n; }
 	void dispatch(TASK_FUN&& task, bool insertFront = false, bool tryNoQueue = false);
-	Timer* addTimer(unsigned int ms, Timer::TIMER_FUN task, void* arg = NULL);
-	void delTimer(Timer* t);
+	TimerId addTimer(unsigned int ms, Timer::TIMER_FUN task, void* arg = NULL);
+	// 可在任意线程调用，返回后不会再触发；id对应的timer已触发过时什么都不做
+	void delTimer(TimerId id);
+	// 重新计时，timer已触发或已删除时返回false。
+	// 跨线程调用时异步重置，结果未知，也返回false；必须保证timer存在的调用方应delTimer后重新addTimer
+	bool resetTimer(TimerId id, unsigned int ms);
+	// 微秒级高精度timer，Linux+epoll下由timerfd唤醒，其他平台精度退化为毫秒。回调返回值单位为us
+	TimerId addTimer(std::chrono::microseconds us, Timer::TIMER_FUN task, void* arg = NULL);
+	bool resetTimer(TimerId id, std::chrono::microseconds us);
 	void delay(unsigned int ms, Timer::TIMER_FUN&& task, void* arg = NULL);
+	// 把work放到DispatchQueue(默认DispatchQueue::workerPool())的工作线程上执行，完成后done回到本线程执行。
+	// work返回void时done无参数，否则done的参数为work的返回值
+	template<typename Work, typename Done>
+	void offload(Work&& work, Done&& done, DispatchQueue* queue = nullptr);
 	bool isCurrentThread() {
 		auto id = std::this_thread::get_id();
 		return _selfThreadid == id;
 	}
+	// 本线程上新建的连接默认以边沿触发注册
+	void setEdgeTriggered(bool on) { _edgeTriggered = on; }
+	bool edgeTriggered() const { return _edgeTriggered; }
+	// 边沿触发下单个fd每次唤醒最多读写的字节数，超出后让给其他fd
+	void setIoBudget(size_t bytes) { _ioBudget = bytes ? bytes : kDefaultIoBudget; }
+	size_t ioBudget() const { return _ioBudget; }
+	// 单次epoll_wait最多取回的事件数。批次从kInitialEvents开始，取满时倍增直到此上限
+	void setMaxEvents(int n) { _maxEvents = n > 0 ? n : kDefaultMaxEvents; }
+	int maxEvents() const { return _maxEvents; }
+
+	static const size_t kDefaultIoBudget = 1024 * 1024;
+	static const int kInitialEvents = 64;
+	static const int kDefaultMaxEvents = 4096;
+
+	// 低延迟模式：阻塞等待前先以0超时轮询spinUs微秒，0为关闭。
+	// soBusyPollUs>0时，之后加入的socket会设置SO_BUSY_POLL(仅Linux)
+	void setBusyPoll(unsigned int spinUs, int soBusyPollUs = 0);
+	unsigned int busyPollUs() const { return _busyPollUs; }
+	// 把loop线程绑定到指定CPU
+	bool setCpuAffinity(int cpu);
+	bool setCpuAffinity(const std::vector<int>& cpus);
+	// loop线程之后分配的内存优先来自该NUMA节点(仅Linux)，在loop线程中异步生效
+	void setMemoryNode(int node);
+	int memoryNode() const { return _memoryNode; }
+
+	IoBackend backend() const { return _uring ? IoBackend::IoUring : IoBackend::Epoll; }
+	// addRecvEvent是否由io_uring recv完成读
+	bool uringRecv() const { return _uringRecv; }
+
+	// loop统计：fd回调/任务/timer的耗时，任务排队时间，timer延迟，最慢回调的来源。
+	// 默认关闭，关闭时loop不额外读时钟。单次回调超过stallMs毫秒记为stall并告警
+	void setStatsEnabled(bool on, unsigned int stallMs = kDefaultStallMs);
+	bool statsEnabled() const { return _statsEnabled.load(std::memory_order_relaxed); }
+	// 可在任意线程读取
+	const LoopStats& stats() const { return _stats; }
+	void resetStats();
+	// loop当前所在回调已执行的时间(us)及其label，不在回调中或未开启统计时为0
+	uint64_t currentCallbackUs() const;
+	const char* currentCallbackLabel() const { return _callbackLabel.load(std::memory_order_relaxed); }
+
+	static const unsigned int kDefaultStallMs = 10;
+
+	// loop线程中Buffer等缓冲区的内存池
+	BufferPool& bufferPool() { return _bufferPool; }
+	BufferPoolStats bufferPoolStats() const { return _bufferPool.stats(); }
 
 protected:
 	//uint64_t processExpireTasks();
-	Timer* addTimerInLoop(unsigned int ms, Timer::TIMER_FUN task, void* arg = NULL);
-	bool delTimerInLoop(Timer* t);
+	TimerId addTimerInLoop(unsigned int ms, Timer::TIMER_FUN task, void* arg = NULL);
+	void addEventInLoop(Event* ev);
+	bool delTimerInLoop(TimerId id);
 
 	void loopOnce();
+	void updateLoad();
+	// 等待并分发事件，返回就绪的事件数
+	int pollEvents(int timeout);
+	bool busyPoll();
 	void runloop();
-	void onPipeEvent();
+	void onWakeup();
+	void onTimerFd();
+	void armTimerFd();
+	void runTasks();
+	bool hasPendingTasks();
+	Event* findEvent(int fd) {
+		return fd >= 0 && (size_t)fd < _events.size() ? _events[fd] : nullptr;
+	}
+	Event* insertEvent(int fd, int type, EventHandleFun&& callback, const char* label = nullptr);
+	Event* insertEvent(Event* ev);
+	void freeRetiredEvents();
+	void flushEventChanges();
+	void uringArm(Event* ev);
+	void uringDisarm(Event* ev);
+	int waitUring(int timeout);
+	void uringArmRecv(Event* ev);
+	void onUringCompletion(uint64_t userData, int res, bool more, int bufId);
+	void onUringAccept(Event* ev, int res, bool more);
+	void onUringRecv(Event* ev, int fd, int res, int bufId);
+	void invokeEvent(Event* ev, int fd, int eventType);
+	template<typename F>
+	void invokeTimed(Event* ev, int fd, F&& call);
+	void runTask(QueuedTask& task);
+	void recordCost(SlowKind kind, int fd, const char* label, uint64_t costUs);
 
-	std::unordered_map<int, Event > _event_map;
+	// 以fd为下标的事件表，epoll_event.data.ptr直接指向其中的Event
+	std::vector<Event*> _events;
+	std::atomic<size_t> _eventCount{ 0 };
+	// 已移除但本批次epoll结果可能还引用的Event，本轮loop结束再释放
+	std::vector<Event*> _retiredEvents;
+	// 本轮修改过type、还没同步到epoll的事件
+	std::vector<Event*> _dirtyEvents;
+	std::vector<Event*> _pollEvents; // 与_pollfds一一对应
 	//std::multimap<uint64_t, TIMER_FUN> _delayTask;
 	TimerManager _timerMan;
 	std::vector<struct pollfd> _pollfds;
 	std::thread _thread;
 	std::thread::id _selfThreadid;
-	std::mutex _taskMutex;
-	std::list<TASK_FUN> _taskQueue;
-	PipeWrap _pipe;
+	MpscQueue<QueuedTask> _taskQueue;
+	MpscQueue<QueuedTask> _frontTaskQueue; // dispatch(insertFront=true)
+	std::vector<QueuedTask> _frontBatch;
+	// 已入队未执行的任务数，入队前加一，所以可能短暂大于实际可pop的数量
+	std::atomic<size_t> _pendingTasks{ 0 };
+	EventNotifier _notifier;
+	// loop阻塞在epoll_wait/poll中时为true，只有此时dispatch才需要唤醒
+	std::atomic<bool> _sleeping{ false };
+	// 已发出唤醒但loop尚未处理，期间的dispatch不再重复唤醒
+	std::atomic<bool> _wakeupPending{ false };
 	bool _threadCancel;
+	int _timerFd = -1;
+	unsigned long long _timerFdExpire = 0; // timerfd当前设定的到期时间(us)，0为未设定
+
+	bool _edgeTriggered = false;
+	size_t _ioBudget = kDefaultIoBudget;
+	unsigned int _busyPollUs = 0;
+	int _soBusyPollUs = 0;
+	int _memoryNode = -1;
+
+	// 负载统计，_waitNs/_ioBytes只在loop线程读写，每个窗口结束时汇总发布到原子变量
+	static const uint64_t kLoadWindowNs = 100 * 1000 * 1000;
+	uint64_t _loadWindowStart = 0;
+	uint64_t _waitNs = 0;
+	uint64_t _ioBytes = 0;
+	std::atomic<uint32_t> _busyPermille{ 0 };
+	std::atomic<uint64_t> _bytesPerSec{ 0 };
+
+	LoopStats _stats;
+	std::atomic<bool> _statsEnabled{ false };
+	std::atomic<uint64_t> _stallUs{ kDefaultStallMs * 1000 };
+	uint64_t _wakeNs = 0;         // 最近一次epoll_wait/poll返回的时间
+	uint64_t _lastStallLogMs = 0; // stall告警限频
+	std::atomic<uint64_t> _callbackStartNs{ 0 };
+	std::atomic<const char*> _callbackLabel{ nullptr };
+
+	BufferPool _bufferPool;
 
 	time_t _checkTime = 0;
 	std::mutex _timerMutex;
@@ -109,12 +308,54 @@ protected:
 	#else
 	int _epollfd;
 	#endif
+	std::vector<struct epoll_event> _epollEvents;
 	#endif
+	int _maxEvents = kDefaultMaxEvents;
+	std::unique_ptr<IoUringPoller> _uring; // 为空时使用epoll/poll
+	uint32_t _uringSeq = 0;
+	bool _uringRecv = false; // 已注册接收缓冲区
+	static const unsigned kRecvBufferCount = 256;
+	static const unsigned kRecvBufferSize = 16 * 1024;
 
 private:
-	EventThread(bool fromCurrentThread = false);
+	EventThread(bool fromCurrentThread = false, IoBackend backend = IoBackend::Epoll);
+};
+
+struct EventThreadPoolConfig
+{
+	int poolSize = 4;
+	IoBackend backend = IoBackend::Epoll;
+	// 第i个线程绑定到cpuSets[i % cpuSets.size()]
+	std::vector<std::vector<int>> cpuSets;
+	// cpuSets为空时按CPU拓扑自动给每个线程分配一个CPU
+	bool autoAffinity = false;
+	// 绑定了CPU的线程，其内存(读缓冲、写队列等)优先从CPU所在的NUMA节点分配
+	bool numaLocal = false;
 };
 
+template<typename Work, typename Done>
+void EventThread::offload(Work&& work, Done&& done, DispatchQueue* queue)
+{
+	if (!queue) {
+		queue = DispatchQueue::workerPool();
+	}
+	queue->dispatch([this, work = std::forward<Work>(work), done = std::forward<Done>(done)]() mutable {
+		using R = decltype(work());
+		if constexpr (std::is_void<R>::value) {
+			work();
+			dispatch([done = std::move(done)]() mutable {
+				done();
+			});
+		}
+		else {
+			R result = work();
+			dispatch([done = std::move(done), result = std::move(result)]() mutable {
+				done(std::move(result));
+			});
+		}
+	});
+}
+
 class EventThreadPool
 {
 public:
@@ -122,10 +363,21 @@ public:
 	~EventThreadPool() {}
 	static EventThreadPool& instance();
 
-	void init(int poolSize = 4);
+	void init(int poolSize = 4, IoBackend backend = IoBackend::Epoll);
+	void init(const EventThreadPoolConfig& config);
 	void fini();
 	void forEach(const std::function<void(EventThread*)>& cb);
+	// 按setPlacementPolicy设置的策略选择线程，默认PowerOfTwoChoices
 	EventThread* getIdlestThread();
+	EventThread* pickThread(PlacementPolicy policy);
+	// 需在init后、开始分配连接前设置
+	void setPlacementPolicy(PlacementPolicy policy) { _policy = policy; }
+	// 负载分越小越空闲，默认为 busyRatio*100 + pendingTasks*0.1 + fds*0.01 + MB/s*0.1
+	void setLoadScorer(std::function<double(const ThreadLoad&)> scorer) { _scorer = std::move(scorer); }
+	double loadScore(EventThread* thread) const;
+	size_t size() const { return _threads.size(); }
+	// 用于按线程单独配置，如setBusyPoll/setCpuAffinity
+	EventThread* getThread(size_t index) { return index < _threads.size() ? _threads[index] : nullptr; }
 	EventThread* debugThread() {
 		return _debugThread;
 	}
@@ -133,6 +385,8 @@ public:
 private:
 	std::vector<EventThread*> _threads;
 	EventThread* _debugThread = nullptr;
+	PlacementPolicy _policy = PlacementPolicy::PowerOfTwoChoices;
+	std::function<double(const ThreadLoad&)> _scorer;
 };
 
 } // ns DLNetwork
\ No newline at end of file
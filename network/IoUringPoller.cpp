@@ -0,0 +1,443 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "IoUringPoller.h"
+#include <MyLog.h>
+#include <algorithm>
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#endif
+
+using namespace DLNetwork;
+
+#ifdef HAVE_IO_URING
+
+#ifndef IORING_ACCEPT_MULTISHOT
+// 旧版本头文件没有，值是内核ABI
+#define IORING_ACCEPT_MULTISHOT (1U << 0)
+#endif
+
+// provided buffer ring(5.19)，旧头文件没有，按内核ABI定义
+static const unsigned kRegisterPbufRing = 22;
+static const uint16_t kRecvBufGroup = 0;
+
+struct BufRingEntry {
+	uint64_t addr;
+	uint32_t len;
+	uint16_t bid;
+	uint16_t resv; // 第0项的resv是环的tail
+};
+
+struct BufRingReg {
+	uint64_t ringAddr;
+	uint32_t ringEntries;
+	uint16_t bgid;
+	uint16_t flags;
+	uint64_t resv[3];
+};
+
+static inline unsigned* ringPtr(void* ring, unsigned offset) {
+	return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+IoUringPoller::~IoUringPoller() {
+	if (_bufRing) {
+		// 内核持有环的页，先关闭io_uring再释放
+		if (_ringFd >= 0) {
+			close(_ringFd);
+			_ringFd = -1;
+		}
+		munmap(_bufRing, _bufRingSize);
+	}
+	if (_sqes) {
+		munmap(_sqes, _sqesSize);
+	}
+	if (_cqRing && _cqRing != _sqRing) {
+		munmap(_cqRing, _cqRingSize);
+	}
+	if (_sqRing) {
+		munmap(_sqRing, _sqRingSize);
+	}
+	if (_ringFd >= 0) {
+		close(_ringFd);
+	}
+}
+
+bool IoUringPoller::init(unsigned entries) {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	_ringFd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (_ringFd < 0) {
+		mWarning() << "io_uring_setup failed:" << strerror(errno);
+		return false;
+	}
+	// EXT_ARG(5.11)用于带超时的等待；RSRC_TAGS(5.13)与multishot poll同版本引入，用来判断内核是否支持
+	const unsigned required = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+	if ((p.features & required) != required) {
+		mWarning() << "io_uring features not supported:" << p.features;
+		return false;
+	}
+
+	_sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	_cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool singleMmap = p.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMmap) {
+		_sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+	}
+	_sqRing = mmap(0, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+	if (_sqRing == MAP_FAILED) {
+		_sqRing = nullptr;
+		mWarning() << "io_uring mmap sq ring failed:" << strerror(errno);
+		return false;
+	}
+	if (singleMmap) {
+		_cqRing = _sqRing;
+	}
+	else {
+		_cqRing = mmap(0, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+		if (_cqRing == MAP_FAILED) {
+			_cqRing = nullptr;
+			mWarning() << "io_uring mmap cq ring failed:" << strerror(errno);
+			return false;
+		}
+	}
+	_sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+	_sqes = mmap(0, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+	if (_sqes == MAP_FAILED) {
+		_sqes = nullptr;
+		mWarning() << "io_uring mmap sqes failed:" << strerror(errno);
+		return false;
+	}
+
+	_sqHead = ringPtr(_sqRing, p.sq_off.head);
+	_sqTail = ringPtr(_sqRing, p.sq_off.tail);
+	_sqArray = ringPtr(_sqRing, p.sq_off.array);
+	_sqMask = *ringPtr(_sqRing, p.sq_off.ring_mask);
+	_sqEntries = p.sq_entries;
+	_sqLocalTail = *_sqTail;
+
+	_cqHead = ringPtr(_cqRing, p.cq_off.head);
+	_cqTail = ringPtr(_cqRing, p.cq_off.tail);
+	_cqMask = *ringPtr(_cqRing, p.cq_off.ring_mask);
+	_cqes = static_cast<char*>(_cqRing) + p.cq_off.cqes;
+	return true;
+}
+
+unsigned IoUringPoller::pendingSubmit() const {
+	return _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+}
+
+int IoUringPoller::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+	// 发布已填好的sqe
+	__atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+	int ret = (int)syscall(__NR_io_uring_enter, _ringFd, toSubmit, minComplete, flags, arg, argSize);
+	return ret < 0 ? -errno : ret;
+}
+
+void* IoUringPoller::getSqe() {
+	if (pendingSubmit() >= _sqEntries) {
+		// 提交队列满了，先提交一批
+		int ret = enter(_sqEntries, 0, 0, nullptr, 0);
+		if (ret < 0 || pendingSubmit() >= _sqEntries) {
+			mCritical() << "io_uring submit failed:" << strerror(ret < 0 ? -ret : EBUSY);
+			return nullptr;
+		}
+	}
+	unsigned index = _sqLocalTail & _sqMask;
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(_sqes) + index;
+	memset(sqe, 0, sizeof(*sqe));
+	_sqArray[index] = index;
+	_sqLocalTail++;
+	return sqe;
+}
+
+void IoUringPoller::pollAdd(int fd, uint32_t pollMask, bool multishot, uint64_t userData) {
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(getSqe());
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = pollMask;
+	sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+	sqe->user_data = userData;
+}
+
+void IoUringPoller::pollRemove(uint64_t userData) {
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(getSqe());
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = userData;
+	sqe->user_data = kInternalUserData;
+}
+
+void IoUringPoller::acceptMultishot(int fd, uint64_t userData) {
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(getSqe());
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = fd;
+	// multishot下不取对端地址，需要时由连接自己getpeername
+	sqe->addr = 0;
+	sqe->addr2 = 0;
+	sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->user_data = userData;
+}
+
+void IoUringPoller::cancel(uint64_t userData) {
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(getSqe());
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = userData;
+	sqe->user_data = kInternalUserData;
+}
+
+bool IoUringPoller::setupRecvBuffers(unsigned count, unsigned size) {
+	if (count == 0 || (count & (count - 1)) || count > 32768) {
+		return false;
+	}
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t ringSize = (count * sizeof(BufRingEntry) + page - 1) / page * page;
+	_bufRingSize = ringSize + (size_t)count * size;
+	// 缓冲区不预先populate，用到才分配物理页
+	void* mem = mmap(0, _bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		mWarning() << "io_uring mmap recv buffers failed:" << strerror(errno);
+		return false;
+	}
+	BufRingReg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ringAddr = reinterpret_cast<uint64_t>(mem);
+	reg.ringEntries = count;
+	reg.bgid = kRecvBufGroup;
+	if (syscall(__NR_io_uring_register, _ringFd, kRegisterPbufRing, &reg, 1) < 0) {
+		mInfo() << "io_uring provided buffer ring not supported:" << strerror(errno);
+		munmap(mem, _bufRingSize);
+		return false;
+	}
+	_bufRing = mem;
+	_bufs = static_cast<char*>(mem) + ringSize;
+	_bufCount = count;
+	_bufSize = size;
+	for (unsigned i = 0; i < count; i++) {
+		recycleRecvBuffer((int)i);
+	}
+	return true;
+}
+
+void IoUringPoller::recv(int fd, uint64_t userData) {
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(getSqe());
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->len = _bufSize;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = kRecvBufGroup;
+	sqe->user_data = userData;
+}
+
+const char* IoUringPoller::recvBuffer(int bufId) const {
+	return _bufs + (size_t)bufId * _bufSize;
+}
+
+void IoUringPoller::recycleRecvBuffer(int bufId) {
+	BufRingEntry* ring = static_cast<BufRingEntry*>(_bufRing);
+	BufRingEntry& e = ring[_bufTail & (_bufCount - 1)];
+	e.addr = reinterpret_cast<uint64_t>(_bufs + (size_t)bufId * _bufSize);
+	e.len = _bufSize;
+	e.bid = (uint16_t)bufId;
+	_bufTail++;
+	// 每次归还立即发布，同一批完成事件里后面的recv就能用上
+	__atomic_store_n(&ring[0].resv, _bufTail, __ATOMIC_RELEASE);
+}
+
+int IoUringPoller::submitAndWait(int timeoutMs) {
+	unsigned toSubmit = pendingSubmit();
+	bool haveCompletion = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE) != *_cqHead;
+	if (timeoutMs == 0 || haveCompletion) {
+		if (toSubmit == 0) {
+			return 0;
+		}
+		int ret = enter(toSubmit, 0, 0, nullptr, 0);
+		return ret < 0 && ret != -EINTR ? ret : 0;
+	}
+
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	if (timeoutMs > 0) {
+		ts.tv_sec = timeoutMs / 1000;
+		ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+		arg.ts = reinterpret_cast<uint64_t>(&ts);
+	}
+	int ret = enter(toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+	if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+		return ret;
+	}
+	return 0;
+}
+
+bool IoUringPoller::nextCompletion(Completion& c) {
+	unsigned head = *_cqHead;
+	if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+	struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>(_cqes) + (head & _cqMask);
+	c.userData = cqe->user_data;
+	c.res = cqe->res;
+	c.more = cqe->flags & IORING_CQE_F_MORE;
+	c.bufId = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+	// 逐个归还cq槽位，回调里提交新请求不会被已读完的cqe占住
+	__atomic_store_n(_cqHead, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+#else
+
+IoUringPoller::~IoUringPoller() {
+}
+
+bool IoUringPoller::init(unsigned entries) {
+	return false;
+}
+
+void IoUringPoller::pollAdd(int fd, uint32_t pollMask, bool multishot, uint64_t userData) {
+}
+
+void IoUringPoller::pollRemove(uint64_t userData) {
+}
+
+void IoUringPoller::acceptMultishot(int fd, uint64_t userData) {
+}
+
+void IoUringPoller::cancel(uint64_t userData) {
+}
+
+bool IoUringPoller::setupRecvBuffers(unsigned count, unsigned size) {
+	return false;
+}
+
+void IoUringPoller::recv(int fd, uint64_t userData) {
+}
+
+const char* IoUringPoller::recvBuffer(int bufId) const {
+	return nullptr;
+}
+
+void IoUringPoller::recycleRecvBuffer(int bufId) {
+}
+
+bool IoUringPoller::setupRecvBuffers(unsigned count, unsigned size) {
+	if (count == 0 || (count & (count - 1)) || count > 32768) {
+		return false;
+	}
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t ringSize = (count * sizeof(BufRingEntry) + page - 1) / page * page;
+	_bufRingSize = ringSize + (size_t)count * size;
+	// 缓冲区不预先populate，用到才分配物理页
+	void* mem = mmap(0, _bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		mWarning() << "io_uring mmap recv buffers failed:" << strerror(errno);
+		return false;
+	}
+	BufRingReg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ringAddr = reinterpret_cast<uint64_t>(mem);
+	reg.ringEntries = count;
+	reg.bgid = kRecvBufGroup;
+	if (syscall(__NR_io_uring_register, _ringFd, kRegisterPbufRing, &reg, 1) < 0) {
+		mInfo() << "io_uring provided buffer ring not supported:" << strerror(errno);
+		munmap(mem, _bufRingSize);
+		return false;
+	}
+	_bufRing = mem;
+	_bufs = static_cast<char*>(mem) + ringSize;
+	_bufCount = count;
+	_bufSize = size;
+	for (unsigned i = 0; i < count; i++) {
+		recycleRecvBuffer((int)i);
+	}
+	return true;
+}
+
+void IoUringPoller::recv(int fd, uint64_t userData) {
+	struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(getSqe());
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->len = _bufSize;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = kRecvBufGroup;
+	sqe->user_data = userData;
+}
+
+const char* IoUringPoller::recvBuffer(int bufId) const {
+	return _bufs + (size_t)bufId * _bufSize;
+}
+
+void IoUringPoller::recycleRecvBuffer(int bufId) {
+	BufRingEntry* ring = static_cast<BufRingEntry*>(_bufRing);
+	BufRingEntry& e = ring[_bufTail & (_bufCount - 1)];
+	e.addr = reinterpret_cast<uint64_t>(_bufs + (size_t)bufId * _bufSize);
+	e.len = _bufSize;
+	e.bid = (uint16_t)bufId;
+	_bufTail++;
+	// 每次归还立即发布，同一批完成事件里后面的recv就能用上
+	__atomic_store_n(&ring[0].resv, _bufTail, __ATOMIC_RELEASE);
+}
+
+int IoUringPoller::submitAndWait(int timeoutMs) {
+	return -1;
+}
+
+bool IoUringPoller::nextCompletion(Completion& c) {
+	return false;
+}
+
+#endif // HAVE_IO_URING
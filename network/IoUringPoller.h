@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+namespace DLNetwork {
+
+// io_uring事件后端，直接用系统调用，不依赖liburing
+// 普通fd用就绪通知(IORING_OP_POLL_ADD)；监听socket可用完成模式的multishot accept，完成事件直接带回新连接fd
+// 连接的读可用完成模式的recv，数据由内核读进注册的provided buffer ring(5.19以上)
+// 请求只写入共享内存的提交队列，等到wait时随同一次io_uring_enter提交，一轮loop只有一次系统调用
+// 非Linux或内核不支持(需要5.13以上的multishot poll)时init返回false
+class IoUringPoller {
+public:
+	IoUringPoller() {}
+	~IoUringPoller();
+	IoUringPoller(const IoUringPoller&) = delete;
+	IoUringPoller& operator=(const IoUringPoller&) = delete;
+
+	bool init(unsigned entries);
+	// pollMask为poll(2)的POLLIN/POLLOUT；multishot为false时触发一次即失效
+	void pollAdd(int fd, uint32_t pollMask, bool multishot, uint64_t userData);
+	// 撤销userData对应的poll请求，被撤销的请求会收到-ECANCELED
+	void pollRemove(uint64_t userData);
+	// 监听socket上的multishot accept(5.19以上)，每个新连接一个完成事件，res为新连接fd(非阻塞)
+	// 内核不支持时完成事件res为-EINVAL
+	void acceptMultishot(int fd, uint64_t userData);
+	// 撤销userData对应的任意请求(IORING_OP_ASYNC_CANCEL)
+	void cancel(uint64_t userData);
+	// 注册count个(2的幂)size字节的接收缓冲区，内核不支持provided buffer ring时返回false
+	bool setupRecvBuffers(unsigned count, unsigned size);
+	// 单次recv，内核从接收缓冲区中挑一个装数据，完成事件的bufId指明是哪个
+	void recv(int fd, uint64_t userData);
+	const char* recvBuffer(int bufId) const;
+	// 回调用完数据后归还缓冲区
+	void recycleRecvBuffer(int bufId);
+	// 提交积攒的请求并等待完成事件。timeoutMs<0无限等待，0不等待。返回负的错误码
+	int submitAndWait(int timeoutMs);
+	// 对每个完成事件调用f(userData, res, more, bufId)，more为true表示multishot请求仍然有效
+	// bufId为recv用掉的接收缓冲区，没有时为-1
+	template<typename F>
+	unsigned forEachCompletion(F&& f) {
+		unsigned n = 0;
+		Completion c;
+		while (nextCompletion(c)) {
+			f(c.userData, c.res, c.more, c.bufId);
+			n++;
+		}
+		return n;
+	}
+
+	// 内部请求(如pollRemove)的完成事件使用的userData
+	static const uint64_t kInternalUserData = ~0ULL;
+
+private:
+	struct Completion {
+		uint64_t userData;
+		int res;
+		bool more;
+		int bufId;
+	};
+	bool nextCompletion(Completion& c);
+	void* getSqe();
+	int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize);
+	unsigned pendingSubmit() const;
+
+	int _ringFd = -1;
+	void* _sqRing = nullptr;
+	size_t _sqRingSize = 0;
+	void* _cqRing = nullptr;
+	size_t _cqRingSize = 0;
+	void* _sqes = nullptr;
+	size_t _sqesSize = 0;
+
+	unsigned* _sqHead = nullptr;
+	unsigned* _sqTail = nullptr;
+	unsigned* _sqArray = nullptr;
+	unsigned _sqMask = 0;
+	unsigned _sqEntries = 0;
+	unsigned _sqLocalTail = 0; // 已填写但还没发布给内核的sqe在_sqLocalTail之前
+
+	unsigned* _cqHead = nullptr;
+	unsigned* _cqTail = nullptr;
+	void* _cqes = nullptr;
+	unsigned _cqMask = 0;
+
+	// provided buffer ring，_bufRing前面是环，后面是各缓冲区
+	void* _bufRing = nullptr;
+	size_t _bufRingSize = 0;
+	char* _bufs = nullptr;
+	unsigned _bufCount = 0;
+	unsigned _bufSize = 0;
+	uint16_t _bufTail = 0;
+};
+
+} //DLNetwork
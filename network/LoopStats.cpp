@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "LoopStats.h"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <stdlib.h>
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+using namespace DLNetwork;
+
+void LoopStats::recordSlow(SlowKind kind, int fd, const char* label, uint64_t costUs)
+{
+	if (costUs <= _slowFloor.load(std::memory_order_relaxed)) {
+		return;
+	}
+	uint64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	std::lock_guard<std::mutex> lock(_slowMutex);
+	auto it = std::upper_bound(_slowest.begin(), _slowest.end(), costUs, [](uint64_t cost, const SlowCallback& s) {
+		return cost > s.costUs;
+	});
+	_slowest.insert(it, SlowCallback{ kind, fd, label, costUs, nowMs });
+	if (_slowest.size() > kSlowest) {
+		_slowest.pop_back();
+	}
+	if (_slowest.size() == kSlowest) {
+		_slowFloor.store(_slowest.back().costUs, std::memory_order_relaxed);
+	}
+}
+
+std::vector<SlowCallback> LoopStats::slowest() const
+{
+	std::lock_guard<std::mutex> lock(_slowMutex);
+	return _slowest;
+}
+
+void LoopStats::reset()
+{
+	callbackUs.reset();
+	dispatchDelayUs.reset();
+	taskUs.reset();
+	queueDelayUs.reset();
+	queueDepth.reset();
+	timerUs.reset();
+	timerLateUs.reset();
+	stalls.store(0, std::memory_order_relaxed);
+	std::lock_guard<std::mutex> lock(_slowMutex);
+	_slowest.clear();
+	_slowFloor.store(0, std::memory_order_relaxed);
+}
+
+std::string LoopStats::demangle(const char* name)
+{
+	if (!name) {
+		return "-";
+	}
+#if defined(__GNUC__)
+	int status = 0;
+	char* s = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	if (s) {
+		std::string ret(s);
+		free(s);
+		return ret;
+	}
+#endif
+	return name;
+}
+
+static void printHistogram(std::ostringstream& os, const char* name, const LatencyHistogram& h)
+{
+	os << name << " count:" << h.count() << " mean:" << h.mean() << " p50:" << h.percentile(0.5)
+		<< " p99:" << h.percentile(0.99) << " max:" << h.max() << "\n";
+}
+
+std::string LoopStats::report() const
+{
+	std::ostringstream os;
+	printHistogram(os, "callbackUs", callbackUs);
+	printHistogram(os, "dispatchDelayUs", dispatchDelayUs);
+	printHistogram(os, "taskUs", taskUs);
+	printHistogram(os, "queueDelayUs", queueDelayUs);
+	printHistogram(os, "queueDepth", queueDepth);
+	printHistogram(os, "timerUs", timerUs);
+	printHistogram(os, "timerLateUs", timerLateUs);
+	os << "stalls:" << stalls.load(std::memory_order_relaxed) << "\n";
+	static const char* kinds[] = { "event", "task", "timer" };
+	for (auto& s : slowest()) {
+		os << "slow " << kinds[(int)s.kind] << " costUs:" << s.costUs << " atMs:" << s.whenMs;
+		if (s.kind == SlowKind::Event) {
+			os << " fd:" << s.fd;
+		}
+		os << " " << demangle(s.label) << "\n";
+	}
+	return os.str();
+}
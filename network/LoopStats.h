@@ -0,0 +1,81 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "LatencyHistogram.h"
+
+namespace DLNetwork {
+
+enum class SlowKind {
+	Event, // fd回调
+	Task,  // dispatch的任务
+	Timer, // timer回调
+};
+
+struct SlowCallback {
+	SlowKind kind;
+	int fd;            // kind为Event时有效
+	const char* label; // 会话类型或回调的type_info::name()，可能为nullptr
+	uint64_t costUs;
+	uint64_t whenMs;   // 发生时间，steady_clock毫秒
+};
+
+/// EventThread的loop统计，由loop线程写入，其他线程可随时读取
+/// 除queueDepth外的直方图单位都是us
+class LoopStats
+{
+public:
+	static const size_t kSlowest = 16;
+
+	LatencyHistogram callbackUs;    // fd回调耗时
+	LatencyHistogram dispatchDelayUs; // epoll_wait返回到fd回调开始，即排在同批次前面的回调耗时
+	LatencyHistogram taskUs;        // dispatch任务执行耗时
+	LatencyHistogram queueDelayUs;  // dispatch入队到开始执行
+	LatencyHistogram queueDepth;    // 每轮开始执行任务时的待执行任务数
+	LatencyHistogram timerUs;       // timer回调耗时
+	LatencyHistogram timerLateUs;   // timer实际执行时间晚于到期时间
+	std::atomic<uint64_t> stalls{ 0 }; // 单次耗时超过stall阈值的次数
+
+	// 保留耗时最长的kSlowest个回调，低于当前入榜门槛时不加锁
+	void recordSlow(SlowKind kind, int fd, const char* label, uint64_t costUs);
+	// 按耗时降序
+	std::vector<SlowCallback> slowest() const;
+	void reset();
+	// 多行文本：各直方图的count/mean/p50/p99/max，stall次数和最慢回调列表
+	std::string report() const;
+
+	// type_info::name()等编译器修饰过的名字转成可读形式
+	static std::string demangle(const char* name);
+
+private:
+	mutable std::mutex _slowMutex;
+	std::vector<SlowCallback> _slowest;
+	std::atomic<uint64_t> _slowFloor{ 0 };
+};
+
+} // ns DLNetwork
@@ -41,7 +41,7 @@ void MyHttp2Session::stop()
 {
     if (_closeTimer) {
         thread()->delTimer(_closeTimer);
-        _closeTimer = nullptr;
+        _closeTimer = TimerId();
     }
 
     if (_conn) {
@@ -297,12 +297,20 @@ void MyHttp2Session::onStreamEnd(std::shared_ptr<MyHttp2Stream> stream)
 void MyHttp2Session::onWriteDone() {
 }
 
-void MyHttp2Session::send(const char* buf, size_t size)
+size_t MyHttp2Session::send(const char* buf, size_t size)
 {
     if (_closed) {
-        return;
+        return 0;
+    }
+    return Session::send(buf, size);
+}
+
+size_t MyHttp2Session::send(std::string&& data)
+{
+    if (_closed) {
+        return 0;
     }
-    Session::send(buf, size);
+    return Session::send(std::move(data));
 }
 
 H2Frame* MyHttp2Session::parseFrame(const FrameHeader& hdr, const uint8_t* payload)
@@ -435,13 +443,17 @@ void MyHttp2Session::connectionError(H2Error err)
 }
 
 void MyHttp2Session::refreshCloseTimer() {
-    std::weak_ptr<MyHttp2Session> weakThis(std::static_pointer_cast<MyHttp2Session>(shared_from_this()));
+    // 时间轮上直接重置，无需删除再添加；重置失败或结果未知(跨线程)时删掉旧的重新添加
     if (_closeTimer) {
+        if (thread()->resetTimer(_closeTimer, 30000)) {
+            return;
+        }
         thread()->delTimer(_closeTimer);
-        _closeTimer = nullptr;
     }
+    std::weak_ptr<MyHttp2Session> weakThis(std::static_pointer_cast<MyHttp2Session>(shared_from_this()));
     _closeTimer = thread()->addTimer(30000, [weakThis](void*) {
         if (auto strongThis = weakThis.lock()) {
+            strongThis->_closeTimer = TimerId();
             strongThis->_conn->closeAfterWrite();
         }
         return 0;
@@ -451,7 +463,7 @@ void MyHttp2Session::refreshCloseTimer() {
     //     if (auto strongThis = weakThis.lock()) {
     //         if (strongThis->_closeTimer) {
     //             strongThis->thread()->delTimerInLoop(strongThis->_closeTimer);
-    //             strongThis->_closeTimer = nullptr;
+    //             strongThis->_closeTimer = TimerId();
     //         }
     //         strongThis->_closeTimer = strongThis->thread()->addTimerInLoop(30000, [weakThis](void*) {
     //             if (auto strongThis = weakThis.lock()) {
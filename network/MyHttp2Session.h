@@ -76,7 +76,8 @@ private:
     void onStreamEnd(std::shared_ptr<MyHttp2Stream> stream);
     void refreshCloseTimer();
 
-    void send(const char* buf, size_t size);
+    size_t send(const char* buf, size_t size);
+    size_t send(std::string&& data) override;
     int sendHeadersFrame(HeadersFrame* frame);
     void applySettings(SettingsFrame* frame);
     void setInitialWindowsSize(uint32_t size) {
@@ -103,7 +104,7 @@ private:
     bool _closed;
     UrlHandler _handler;
     ClosedHandler _closedHandler;
-    Timer* _closeTimer = nullptr;
+    TimerId _closeTimer;
 
     std::unordered_map<uint32_t, std::shared_ptr<MyHttp2Stream>> _streams;
     Buffer _headersBuf;
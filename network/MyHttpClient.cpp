@@ -101,9 +101,9 @@ void DLNetwork::MyHttpClient::connect(std::string host, int port, bool tls, std:
     _host = host;
     _port = port;
     _certFile = certFile;
-    _connection->setOnMessage(std::bind(&MyHttpClient::onMessage, this, std::placeholders::_1, std::placeholders::_2));
-    _connection->setOnWriteDone(std::bind(&MyHttpClient::onWriteDone, this, std::placeholders::_1));
-    _connection->setConnectCallback(std::bind(&MyHttpClient::onConnectionChange, this, std::placeholders::_1, std::placeholders::_2));
+    _connection->setOnMessage([this](Connection::Ptr conn, Buffer* buf) { return onMessage(conn, buf); });
+    _connection->setOnWriteDone([this](Connection::Ptr conn) { onWriteDone(conn); });
+    _connection->setConnectCallback([this](Connection::Ptr conn, ConnectEvent e) { onConnectionChange(conn, e); });
 	_connection->startConnect();
 
 }
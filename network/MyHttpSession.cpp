@@ -40,7 +40,7 @@ void DLNetwork::MyHttpSession::stop()
 {
     if (_closeTimer) {
         thread()->delTimer(_closeTimer);
-        _closeTimer = nullptr;
+        _closeTimer = TimerId();
     }
     if (_conn) {
         _conn->close();
@@ -67,13 +67,11 @@ std::string MyHttpSession::makeupResponse(int code, const std::string& content)
 }
 
 void MyHttpSession::response(std::string content) {
-    auto resp = makeupResponse(200, content);
-    send(resp.c_str(), resp.size());
+    send(makeupResponse(200, content));
 }
 
 void MyHttpSession::response(int code, std::string content) {
-    auto resp = makeupResponse(code, content);
-    send(resp.c_str(), resp.size());
+    send(makeupResponse(code, content));
 }
 
 void MyHttpSession::responseFile(std::string content, std::string fname, std::string contentType) {
@@ -91,9 +89,8 @@ void MyHttpSession::responseFile(std::string content, std::string fname, std::st
     }
     resp.headers["Content-Length"] = std::to_string(content.size());
 
-    std::string str = resp.serialize();
-    send(str.c_str(), str.size());
-    send(content.c_str(), content.size());
+    send(resp.serialize());
+    send(std::move(content));
     _conn->closeAfterWrite();
 }
 
@@ -110,22 +107,40 @@ void MyHttpSession::responseFile(std::string filePath) {
         name = filePath;
     }
 
-    FILE* fp = fopen(filePath.c_str(), "rb");
-    if (!fp) {
+    FileRegion file = FileRegion::open(filePath);
+    if (!file.valid()) {
         response(400, std::string("can't open file: ") + filePath);
         return;
     }
 
-    beginFile(name, "");
-    char buf[1024];
-    while (!feof(fp)) {
-        int n = fread(buf, 1, sizeof(buf), fp);
-        if (n > 0) {
-            writeFile(std::string(buf, n));
-        }
+    // 长度已知，用Content-Length代替chunked，文件内容由sendfile直接发送
+    // 头部与beginFile一致
+    HTTP::Response resp;
+    if (version == "HTTP/1.0")
+    {
+        resp.version = HTTP::Version::HTTP_1_0;
+    }
+    else if (version == "HTTP/1.1")
+    {
+        resp.version = HTTP::Version::HTTP_1_1;
+        resp.headers["Access-Control-Allow-Methods"] = "no-cache";
+        resp.headers["Access-Control-Expose-Headers"] = "X-Requested-With";
+        resp.headers["Expires"] = "-1";
+        resp.headers["Pragma"] = "no-cache";
+    }
+    else
+    {
+        resp.version = HTTP::Version::HTTP_1_1;
     }
-    endFile();
-    fclose(fp);
+    resp.responseCode = HTTP::Response::OK;
+    resp.headers["Content-Type"] = "application/octet-stream";
+    resp.headers["Content-Disposition"] = std::string("attachment; filename=\"") + name + "\"";
+    resp.headers["Content-Length"] = std::to_string(file.length());
+    resp.headers["Access-Control-Allow-Origin"] = "*";
+    send(resp.serialize());
+    sendFile(file);
+    refreshCloseTimer();
+    _conn->closeAfterWrite();
 }
 
 void MyHttpSession::beginFile(std::string fname, std::string contentType) {
@@ -158,8 +173,7 @@ void MyHttpSession::beginFile(std::string fname, std::string contentType) {
     }
     resp.headers["Transfer-Encoding"] = "chunked";
     resp.headers["Access-Control-Allow-Origin"] = "*";
-    std::string str = resp.serialize();
-    send(str.c_str(), str.size());
+    send(resp.serialize());
     refreshCloseTimer();
 }
 
@@ -168,7 +182,7 @@ void MyHttpSession::writeFile(std::string content) {
     char szHex[16] = { 0 };
     sprintf(szHex, "%zx", content.size());
     stream << szHex << "\r\n" << content << "\r\n";
-    send(stream.str().c_str(), stream.str().size());
+    send(stream.str());
     refreshCloseTimer();
 }
 
@@ -182,7 +196,7 @@ void MyHttpSession::onClosed() {
     _closed = true;
     if (_closeTimer) {
         thread()->delTimer(_closeTimer);
-        _closeTimer = nullptr;
+        _closeTimer = TimerId();
     }
 
     if (_closedHandler) {
@@ -244,13 +258,17 @@ void MyHttpSession::onWriteDone() {
 }
 
 void MyHttpSession::refreshCloseTimer() {
-    std::weak_ptr<MyHttpSession> weakThis(std::static_pointer_cast<MyHttpSession>(shared_from_this()));
+    // 时间轮上直接重置，无需删除再添加；重置失败或结果未知(跨线程)时删掉旧的重新添加
     if (_closeTimer) {
+        if (thread()->resetTimer(_closeTimer, 30000)) {
+            return;
+        }
         thread()->delTimer(_closeTimer);
-        _closeTimer = nullptr;
     }
+    std::weak_ptr<MyHttpSession> weakThis(std::static_pointer_cast<MyHttpSession>(shared_from_this()));
     _closeTimer = thread()->addTimer(30000, [weakThis](void*) {
         if (auto strongThis = weakThis.lock()) {
+            strongThis->_closeTimer = TimerId();
             strongThis->_conn->closeAfterWrite();
         }
         return 0;
@@ -260,7 +278,7 @@ void MyHttpSession::refreshCloseTimer() {
     //     if (auto strongThis = weakThis.lock()) {
     //         if (strongThis->_closeTimer) {
     //             strongThis->thread()->delTimerInLoop(strongThis->_closeTimer);
-    //             strongThis->_closeTimer = nullptr;
+    //             strongThis->_closeTimer = TimerId();
     //         }
     //         strongThis->_closeTimer = strongThis->thread()->addTimerInLoop(30000, [weakThis](void*) {
     //             if (auto strongThis = weakThis.lock()) {
@@ -273,7 +291,7 @@ void MyHttpSession::refreshCloseTimer() {
     //     });
 }
 
-void DLNetwork::MyHttpSession::send(const char* buf, size_t size)
+size_t DLNetwork::MyHttpSession::send(const char* buf, size_t size)
 {
-    Session::send(buf, size);
+    return Session::send(buf, size);
 }
@@ -74,12 +74,13 @@ private:
         _handler = handler;
     }
     void refreshCloseTimer();
-    void send(const char* buf, size_t size);
+    using Session::send;
+    size_t send(const char* buf, size_t size);
 
     bool _closed = false;
     UrlHandler _handler;
     ClosedHandler _closedHandler;
-    Timer* _closeTimer = nullptr;
+    TimerId _closeTimer;
 };
 
 } //DLNetwork
\ No newline at end of file
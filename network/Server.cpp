@@ -4,7 +4,7 @@
 
 namespace DLNetwork {
 
-Server::Server() : _listenSock(INVALID_SOCKET), _thread(nullptr), _reusePort(true), _timer(nullptr) {
+Server::Server() : _listenSock(INVALID_SOCKET), _thread(nullptr), _reusePort(true) {
 }
 
 Server::~Server() {
@@ -28,7 +28,7 @@ void Server::destroy() {
     _conn_session.clear();
     if (_timer) {
         _thread->delTimer(_timer);
-        _timer = nullptr;
+        _timer = TimerId();
     }
 }
 
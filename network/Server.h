@@ -6,11 +6,11 @@
 #include "Connection.h"
 #include "TcpConnection.h"
 #include "UdpConnection.h"
+#include "TimerManager.h"
 
 namespace DLNetwork {
 
 class EventThread;
-class Timer;
 
 class Server : public std::enable_shared_from_this<Server> {
 public:
@@ -32,7 +32,7 @@ protected:
     INetAddress _listenAddr;
     SessionCreator _sessionCreator;
     bool _reusePort;
-    Timer* _timer;
+    TimerId _timer;
     std::map<Connection::Ptr, std::shared_ptr<Session>> _conn_session;
 };
 
@@ -26,6 +26,7 @@
 #include <functional>
 #include <string.h>
 #include <memory>
+#include <typeinfo>
 #include "platform.h"
 #include "Buffer.h"
 #include "EventThread.h"
@@ -84,12 +85,78 @@ public:
      * 连接成功后每2秒触发一次该事件
      */
     virtual void onManager() {}
-    virtual void send(const char* buf, size_t size){
+    /**
+     * 发送队列达到高水位时触发，生产者应暂停发送，直到onWriteResumed
+     */
+    virtual void onWriteBlocked(size_t /*pending*/) {}
+    /**
+     * 发送队列回落到低水位时触发
+     */
+    virtual void onWriteResumed(size_t /*pending*/) {}
+
+    // 发送队列的高低水位，high为0表示不限制，连接建立前后都可设置
+    void setWriteWatermarks(size_t high, size_t low) {
+        // 与Connection::setWriteWatermarks相同的修正，low不小于high时取high/2
+        _highWatermark = high;
+        _lowWatermark = low < high ? low : high / 2;
+        if (_conn) {
+            _conn->setWriteWatermarks(high, low);
+        }
+    }
+    // 暂停/恢复从连接读数据，上层处理不过来或下游拥塞时让TCP流控生效
+    void pauseReading() {
+        if (_conn) {
+            _conn->pauseReading();
+        }
+    }
+    void resumeReading() {
+        if (_conn) {
+            _conn->resumeReading();
+        }
+    }
+    // onMessage之后缓冲中仍有bytes以上数据时自动暂停读，需调用resumeReading恢复，0表示不限制
+    void setReadBufferLimit(size_t bytes) {
+        _readLimit = bytes;
+        if (_conn) {
+            _conn->setReadBufferLimit(bytes);
+        }
+    }
+    bool writeBlocked() {
+        return _conn && _conn->writeBlocked();
+    }
+    size_t pendingBytes() {
+        return _conn ? _conn->pendingBytes() : 0;
+    }
+
+    // 返回发送队列中待发送的字节数，生产者可据此限流
+    virtual size_t send(const char* buf, size_t size){
         if (_conn) {
             _conn->write(buf, size);
             _sendSize += size;
             _lastActiveTime = time(nullptr);
+            return _conn->pendingBytes();
+        }
+        return 0;
+    }
+    // 接管data，不拷贝
+    virtual size_t send(std::string&& data){
+        if (_conn) {
+            _sendSize += data.size();
+            _conn->write(std::move(data));
+            _lastActiveTime = time(nullptr);
+            return _conn->pendingBytes();
+        }
+        return 0;
+    }
+    // 文件内容由内核直接发往socket，不经过用户态
+    size_t sendFile(const FileRegion& file){
+        if (_conn) {
+            _sendSize += file.length();
+            _conn->write(file);
+            _lastActiveTime = time(nullptr);
+            return _conn->pendingBytes();
         }
+        return 0;
     }
 
 protected:
@@ -114,8 +181,14 @@ protected:
         _conn = conn;
         // 这里不能设置回调，因为TcpServer已经设置过了
         //_conn->setConnectCallback(std::bind(&Session::onConnectionChange, this, std::placeholders::_1, std::placeholders::_2));
-        _conn->setOnMessage(std::bind(&Session::onConnMessage, this, std::placeholders::_1, std::placeholders::_2));
-        _conn->setOnWriteDone(std::bind(&Session::onConnWriteDone, this, std::placeholders::_1));
+        _conn->setOnMessage([this](Connection::Ptr conn, Buffer* buf) { return onConnMessage(conn, buf); });
+        _conn->setOnWriteDone([this](Connection::Ptr conn) { onConnWriteDone(conn); });
+        _conn->setWriteWatermarks(_highWatermark, _lowWatermark);
+        _conn->setReadBufferLimit(_readLimit);
+        _conn->setOnHighWatermark([this](Connection::Ptr, size_t pending) { onWriteBlocked(pending); });
+        _conn->setOnLowWatermark([this](Connection::Ptr, size_t pending) { onWriteResumed(pending); });
+        // 慢回调统计按会话类型归类
+        _conn->setLabel(typeid(*this).name());
         _conn->attach();
 #ifdef ENABLE_OPENSSL
         if (_enableTls) {
@@ -133,6 +206,9 @@ protected:
     int _sendSize = 0;
     int _recvSize = 0;
     int _lastActiveTime = 0;
+    size_t _highWatermark = 0;
+    size_t _lowWatermark = 0;
+    size_t _readLimit = 0;
 
     friend class Server;
     friend class TcpServer;
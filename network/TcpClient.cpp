@@ -93,7 +93,7 @@ bool TcpClient::startConnect() {
     if (ecode == 0 || uvErr == UV_EAGAIN) {
         _state = State::connecting;
         //mInfo() << "TcpClient::startConnect" << "ecode" << ecode << fsock << _name << _serverAddr.description();
-        _thread->addEvent(fsock, EventType::Write, std::bind(&TcpClient::onEvent, this, std::placeholders::_1, std::placeholders::_2));
+        _thread->addEvent(fsock, EventType::Write, [this](int fd, int events) { onEvent(fd, events); });
         return true;
     }
     else {
@@ -175,9 +175,9 @@ void TcpClient::handleWrite(SOCKET sock) {
     }
     _thread->removeEvents(sock);
     _conn = TcpConnection::create(_thread, sock);
-    _conn->setConnectCallback(std::bind(&TcpClient::connectionCallback, this, std::placeholders::_1, std::placeholders::_2));
-    _conn->setOnMessage(std::bind(&TcpClient::messageCallback, this, std::placeholders::_1, std::placeholders::_2));
-    _conn->setOnWriteDone(std::bind(&TcpClient::writedCallback, this, std::placeholders::_1));
+    _conn->setConnectCallback([this](Connection::Ptr conn, ConnectEvent e) { connectionCallback(conn, e); });
+    _conn->setOnMessage([this](Connection::Ptr conn, Buffer* buf) { return messageCallback(conn, buf); });
+    _conn->setOnWriteDone([this](Connection::Ptr conn) { writedCallback(conn); });
     _conn->attach();
 #ifdef ENABLE_OPENSSL
     if (_enableTls) {
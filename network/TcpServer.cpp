@@ -71,7 +71,7 @@ bool TcpServer::start(EventThread* loop, INetAddress listenAddr, SessionCreator
         return false;
     }
 
-    _thread->addEvent(_listenSock, EventType::Read, std::bind(&TcpServer::onEvent, this, std::placeholders::_1, std::placeholders::_2));
+    _thread->addAcceptEvent(_listenSock, [this](int, int fd) { onAccept(fd); });
     std::weak_ptr<Server> weak_this = shared_from_this();
     EventThreadPool::instance().forEach([weak_this](EventThread* thread) {
         thread->addTimer(2000, [weak_this](void*) {
@@ -85,26 +85,16 @@ bool TcpServer::start(EventThread* loop, INetAddress listenAddr, SessionCreator
     return true;
 }
 
-void TcpServer::onEvent(SOCKET sock, int eventType) {
-    //EventThread* t = EventThreadPool::instance().getIdlestThread();
-    //t->dispatch([sock, t, this, eventType]() {
-        sockaddr_in clientAddr;
-        socklen_t nLen = sizeof(sockaddr_in);
-        SOCKET fsock = ::accept(sock, (sockaddr*)&clientAddr, &nLen);
-        if (fsock != -1) {
-            if (_sessionCreator) {
-                auto session = _sessionCreator();
-                auto conn = TcpConnection::create(session->thread(), fsock);
-                conn->setConnectCallback(std::bind(&TcpServer::onConnectionChange, this, std::placeholders::_1, std::placeholders::_2));
-                _conn_session[conn] = session;
-                session->takeoverConn(conn);
-            }
-            else {
-                destroy();
-            }
-        }
-        else {
-            //mWarning() << "TcpServer::onEvent accept error" << get_uv_errmsg();
-        }
-    //});
-}
\ No newline at end of file
+void TcpServer::onAccept(SOCKET fsock) {
+    if (_sessionCreator) {
+        auto session = _sessionCreator();
+        auto conn = TcpConnection::create(session->thread(), fsock);
+        conn->setConnectCallback([this](Connection::Ptr conn, ConnectEvent e) { onConnectionChange(conn, e); });
+        _conn_session[conn] = session;
+        session->takeoverConn(conn);
+    }
+    else {
+        myclose(fsock);
+        destroy();
+    }
+}
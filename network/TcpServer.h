@@ -39,7 +39,8 @@ public:
     
 private:
     TcpServer();
-    void onEvent(SOCKET sock, int eventType);
+    // 监听socket上新连接的fd，io_uring下由multishot accept直接返回，否则在可读通知中accept
+    void onAccept(SOCKET fsock);
 };
 
 } // namespace DLNetwork
\ No newline at end of file
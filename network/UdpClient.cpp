@@ -48,8 +48,8 @@ bool UdpClient::startConnect() {
         return false;
     }
 
-    _connection->setConnectCallback(std::bind(&UdpClient::onConnectionChange, this, std::placeholders::_1, std::placeholders::_2));
-    _connection->setOnMessage(std::bind(&UdpClient::onMessage, this, std::placeholders::_1, std::placeholders::_2));
+    _connection->setConnectCallback([this](Connection::Ptr conn, ConnectEvent e) { onConnectionChange(conn, e); });
+    _connection->setOnMessage([this](Connection::Ptr conn, Buffer* buf) { return onMessage(conn, buf); });
     _connection->startConnect();
 
     return true;
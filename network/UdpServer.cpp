@@ -60,7 +60,7 @@ bool UdpServer::start(EventThread* loop, INetAddress listenAddr, SessionCreator
         return false;
     }
 
-    _thread->addEvent(_listenSock, EventType::Read, std::bind(&UdpServer::onEvent, this, std::placeholders::_1, std::placeholders::_2));
+    _thread->addEvent(_listenSock, EventType::Read, [this](int fd, int events) { onEvent(fd, events); });
     std::weak_ptr<Server> weak_this = shared_from_this();
     EventThreadPool::instance().forEach([weak_this](EventThread* thread) {
         thread->addTimer(2000, [weak_this](void*) {
@@ -98,7 +98,7 @@ void UdpServer::onEvent(SOCKET sock, int eventType) {
                     auto conn = UdpConnection::create(session->thread(), peerAddr, _listenAddr);
                     if (conn) {
                         conn->startConnect();
-                        conn->setConnectCallback(std::bind(&UdpServer::onConnectionChange, this, std::placeholders::_1, std::placeholders::_2));
+                        conn->setConnectCallback([this](Connection::Ptr conn, ConnectEvent e) { onConnectionChange(conn, e); });
                         _conn_session[conn] = session;
                         session->takeoverConn(conn);
                         session->onConnectionChange(conn, ConnectEvent::Established);
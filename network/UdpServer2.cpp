@@ -35,7 +35,7 @@ bool UdpServer2::start(EventThread* loop, INetAddress listenAddr, std::string na
         return false;
     }
 
-    _thread->addEvent(_listenSock, EventType::Read, std::bind(&UdpServer2::onEvent, this, std::placeholders::_1, std::placeholders::_2));
+    _thread->addEvent(_listenSock, EventType::Read, [this](int fd, int events) { onEvent(fd, events); });
     return true;
 }
 
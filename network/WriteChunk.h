@@ -0,0 +1,198 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <memory>
+#include <string>
+#include <variant>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "Buffer.h"
+
+namespace DLNetwork {
+
+/// 不可变、引用计数的数据片段，可在多个连接和线程间共享
+/// 拷贝只增加引用计数，最后一个引用(通常是内核接收完数据后的发送队列)释放时才释放数据
+class SharedSlice
+{
+public:
+	SharedSlice() {}
+	explicit SharedSlice(std::string&& s) {
+		auto owner = std::make_shared<const std::string>(std::move(s));
+		_data = owner->data();
+		_size = owner->size();
+		_owner = std::move(owner);
+	}
+	explicit SharedSlice(Buffer&& b) {
+		auto owner = std::make_shared<const Buffer>(std::move(b));
+		_data = owner->peek();
+		_size = owner->readableBytes();
+		_owner = std::move(owner);
+	}
+	static SharedSlice copyFrom(const char* data, size_t len) {
+		return SharedSlice(std::string(data, len));
+	}
+
+	const char* data() const { return _data; }
+	size_t size() const { return _size; }
+	bool empty() const { return _size == 0; }
+	// 共享同一份数据的子片段
+	SharedSlice slice(size_t offset, size_t len) const {
+		SharedSlice s(*this);
+		offset = offset < _size ? offset : _size;
+		s._data += offset;
+		s._size = len < _size - offset ? len : _size - offset;
+		return s;
+	}
+
+private:
+	std::shared_ptr<const void> _owner;
+	const char* _data = nullptr;
+	size_t _size = 0;
+};
+
+/// 文件的一段(fd, offset, length)，Connection用sendfile发送，数据不经过用户态
+/// 拷贝共享同一个fd，最后一个引用释放时关闭
+class FileRegion
+{
+public:
+	FileRegion() {}
+	// 接管fd
+	FileRegion(int fd, int64_t offset, size_t length)
+		: _file(std::make_shared<File>(fd)), _offset(offset), _length(length) {}
+	// 打开整个文件，失败时valid()为false
+	static FileRegion open(const std::string& path) {
+#ifdef _WIN32
+		int fd = ::_open(path.c_str(), _O_RDONLY | _O_BINARY);
+		if (fd < 0) {
+			return FileRegion();
+		}
+		FileRegion r(fd, 0, 0); // 接管fd，失败返回时随r关闭
+		struct _stat64 st;
+		if (::_fstat64(fd, &st) != 0) {
+			return FileRegion();
+		}
+#else
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			return FileRegion();
+		}
+		FileRegion r(fd, 0, 0); // 接管fd，失败返回时随r关闭
+		struct stat st;
+		if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+			return FileRegion();
+		}
+#endif
+		r._length = (size_t)st.st_size;
+		return r;
+	}
+
+	bool valid() const { return _file != nullptr; }
+	int fd() const { return _file ? _file->fd : -1; }
+	int64_t offset() const { return _offset; }
+	size_t length() const { return _length; }
+	FileRegion slice(size_t offset, size_t len) const {
+		FileRegion r(*this);
+		offset = offset < _length ? offset : _length;
+		r._offset += offset;
+		r._length = len < _length - offset ? len : _length - offset;
+		return r;
+	}
+
+private:
+	struct File {
+		explicit File(int f) : fd(f) {}
+		~File() {
+#ifdef _WIN32
+			::_close(fd);
+#else
+			::close(fd);
+#endif
+		}
+		int fd;
+	};
+	std::shared_ptr<File> _file;
+	int64_t _offset = 0;
+	size_t _length = 0;
+};
+
+/// Connection发送队列中的一项，持有数据的所有权直到发送完
+class WriteChunk
+{
+public:
+	explicit WriteChunk(Buffer&& b) : _data(std::move(b)) {}
+	explicit WriteChunk(std::string&& s) : _data(std::move(s)) {}
+	explicit WriteChunk(const SharedSlice& s) : _data(s) {}
+	explicit WriteChunk(const FileRegion& f) : _data(f) {}
+
+	// 文件段没有内存中的数据，peek()返回nullptr，由sendfile发送
+	bool isFile() const { return _data.index() == 3; }
+	const FileRegion& file() const { return std::get<3>(_data); }
+	// 文件段中下一个要发送的字节在文件中的偏移
+	int64_t fileOffset() const { return std::get<3>(_data).offset() + (int64_t)_offset; }
+
+	// string短字符串移动后地址会变，所以只记偏移，每次取地址
+	const char* peek() const {
+		switch (_data.index()) {
+		case 0: return std::get<0>(_data).peek() + _offset;
+		case 1: return std::get<1>(_data).data() + _offset;
+		case 2: return std::get<2>(_data).data() + _offset;
+		default: return nullptr;
+		}
+	}
+	size_t readableBytes() const {
+		switch (_data.index()) {
+		case 0: return std::get<0>(_data).readableBytes() - _offset;
+		case 1: return std::get<1>(_data).size() - _offset;
+		case 2: return std::get<2>(_data).size() - _offset;
+		default: return std::get<3>(_data).length() - _offset;
+		}
+	}
+	void retrieve(size_t n) {
+		_offset += n;
+	}
+	// 转成共享形式(不拷贝数据)，返回剩余数据的片段。MSG_ZEROCOPY发送后数据要保留到内核通知完成
+	SharedSlice share() {
+		if (_data.index() == 0) {
+			SharedSlice s(std::move(std::get<0>(_data)));
+			_data = std::move(s);
+		}
+		else if (_data.index() == 1) {
+			SharedSlice s(std::move(std::get<1>(_data)));
+			_data = std::move(s);
+		}
+		return std::get<2>(_data).slice(_offset, (size_t)-1);
+	}
+
+private:
+	std::variant<Buffer, std::string, SharedSlice, FileRegion> _data;
+	size_t _offset = 0;
+};
+
+} // namespace DLNetwork
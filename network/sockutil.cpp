@@ -97,6 +97,17 @@ int SockUtil::setKeepAlive(int sockFd, bool on) {
 	return ret;
 }
 
+int SockUtil::setBusyPoll(int sockFd, int usec) {
+	int ret = -1;
+#if defined(SO_BUSY_POLL)
+	ret = setsockopt(sockFd, SOL_SOCKET, SO_BUSY_POLL, (char *)&usec, static_cast<socklen_t>(sizeof(usec)));
+	if (ret == -1) {
+		mDebug() << "设置 SO_BUSY_POLL 失败!";
+	}
+#endif
+	return ret;
+}
+
 int SockUtil::setNoSigpipe(int sd) {
 	int set = 1, ret = 1;
 #if defined(SO_NOSIGPIPE)
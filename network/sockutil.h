@@ -78,6 +78,8 @@ public:
 	static int setReuseable(int sockFd, bool on = true);
 	static int setBroadcast(int sockFd, bool on = true);
 	static int setKeepAlive(int sockFd, bool on = true);
+	// SO_BUSY_POLL，读socket时在驱动队列上空转usec微秒；仅Linux，其他平台返回-1
+	static int setBusyPoll(int sockFd, int usec);
 	static bool getDomainIP(const char* host, uint16_t port, struct sockaddr& addr);
 	//组播相关
 	static int setMultiTTL(int sockFd, uint8_t ttl = 64);
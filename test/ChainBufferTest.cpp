@@ -0,0 +1,171 @@
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "ChainBuffer.h"
+#include "TestUtil.h"
+
+using namespace DLNetwork;
+
+static std::string lines(int n) {
+    std::string s;
+    for (int i = 0; i < n; ++i) {
+        s += "line" + std::to_string(i) + "\r\n";
+    }
+    return s;
+}
+
+// 按奇数长度分块追加，CRLF会跨段
+static void appendOdd(ChainBuffer& b, const std::string& s) {
+    for (size_t i = 0; i < s.size(); i += 7) {
+        b.append(s.data() + i, std::min<size_t>(7, s.size() - i));
+    }
+}
+
+static void testPeekRetrieveFindCRLF() {
+    std::string s = lines(100);
+    ChainBuffer b(16);
+    appendOdd(b, s);
+    CHECK(b.readableBytes() == s.size());
+    CHECK(b.segmentCount() > 10);
+    for (int i = 0; i < 100; ++i) {
+        const char* crlf = b.findCRLF();
+        CHECK(crlf != nullptr);
+        if (!crlf) {
+            return;
+        }
+        std::string line(b.pullup(0), crlf);
+        CHECK(line == "line" + std::to_string(i));
+        CHECK(b.retrieveUntil(crlf + 2));
+    }
+    CHECK(b.empty());
+    CHECK(b.findCRLF() == nullptr);
+
+    ChainBuffer c(16);
+    appendOdd(c, s);
+    CHECK(std::string(c.peek(), c.readableBytes()) == s);
+    CHECK(c.segmentCount() == 1);
+    CHECK(!c.retrieve(s.size() + 1));
+    CHECK(c.retrieveAsString(6) == "line0\r");
+    CHECK(c.retrieveAllAsString() == s.substr(6));
+}
+
+static void testPrependAndInts() {
+    ChainBuffer b(8);
+    b.append("body", 4);
+    b.prepend("HDR", 3);
+    b.prependInt8(7);
+    CHECK(b.readableBytes() == 8);
+    CHECK(b.readInt8() == 7);
+    CHECK(b.retrieveAsString(7) == "HDRbody");
+
+    // 整数跨段
+    ChainBuffer n(3);
+    n.appendInt64(0x0102030405060708LL);
+    n.appendInt32(-5);
+    n.appendInt16(0x1234);
+    n.appendInt8(-1);
+    CHECK(n.segmentCount() > 4);
+    CHECK(n.peekInt64() == 0x0102030405060708LL);
+    CHECK(n.readInt64() == 0x0102030405060708LL);
+    CHECK(n.readInt32() == -5);
+    CHECK(n.readInt16() == 0x1234);
+    CHECK(n.readInt8() == -1);
+    CHECK(n.empty());
+    CHECK(n.peekInt32() == -1);
+    n.prependInt32(42);
+    CHECK(n.readInt32() == 42);
+}
+
+static void testSliceSpliceShare() {
+    std::string s = lines(50);
+    ChainBuffer b(16);
+    appendOdd(b, s);
+    size_t segs = b.segmentCount();
+
+    // 拷贝和slice只共享段
+    ChainBuffer copy = b;
+    CHECK(copy.toStringPiece() == s);
+    ChainBuffer sl = b.slice(6, 40);
+    CHECK(sl.toStringPiece() == s.substr(6, 40));
+    CHECK(b.slice(s.size() - 3, 100).toStringPiece() == s.substr(s.size() - 3));
+    b.retrieveAll();
+    CHECK(sl.toStringPiece() == s.substr(6, 40));
+
+    ChainBuffer dst(16);
+    dst.append("X", 1);
+    dst.splice(copy, 10);
+    CHECK(dst.toStringPiece() == "X" + s.substr(0, 10));
+    CHECK(copy.readableBytes() == s.size() - 10);
+    dst.splice(copy);
+    CHECK(copy.empty());
+    CHECK(dst.toStringPiece() == "X" + s);
+    CHECK(dst.segmentCount() <= segs + 2);
+
+    // 被共享的末段不能原地追加，否则会改到另一方的数据
+    ChainBuffer a;
+    a.append("abc", 3);
+    ChainBuffer c = a.slice(0, 2);
+    a.append("d", 1);
+    c.append("Z", 1);
+    CHECK(a.toStringPiece() == "abcd");
+    CHECK(c.toStringPiece() == "abZ");
+}
+
+static void testIovec() {
+    std::string s = lines(30);
+    ChainBuffer b(16);
+    appendOdd(b, s);
+    struct iovec iov[64];
+    int n = b.fillIovec(iov, 64);
+    CHECK(n == (int)b.segmentCount());
+    std::string joined;
+    for (int i = 0; i < n; ++i) {
+        joined.append((const char*)iov[i].iov_base, iov[i].iov_len);
+    }
+    CHECK(joined == s);
+
+    n = b.fillIovec(iov, 2);
+    CHECK(n == 2);
+    n = b.fillIovec(iov, 64, 20);
+    size_t total = 0;
+    for (int i = 0; i < n; ++i) {
+        total += iov[i].iov_len;
+    }
+    CHECK(total == 20);
+}
+
+static void testReadFd() {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    std::string data(50000, 'q');
+    data[12345] = 'w';
+    CHECK(write(fds[1], data.data(), data.size()) == (ssize_t)data.size());
+    close(fds[1]);
+
+    ChainBuffer b(4096);
+    b.append("pre", 3);
+    int err = 0;
+    size_t got = 0;
+    for (;;) {
+        int32_t n = b.readFd(fds[0], &err);
+        if (n <= 0) {
+            break;
+        }
+        got += n;
+    }
+    close(fds[0]);
+    CHECK(got == data.size());
+    CHECK(b.readableBytes() == data.size() + 3);
+    CHECK(b.toStringPiece() == "pre" + data);
+}
+
+int main() {
+    testPeekRetrieveFindCRLF();
+    testPrependAndInts();
+    testSliceSpliceShare();
+    testIovec();
+    testReadFd();
+    return TEST_RESULT();
+}
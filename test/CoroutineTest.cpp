@@ -0,0 +1,150 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "Coroutine.h"
+#include "TcpConnection.h"
+
+using namespace DLNetwork;
+
+#ifdef DL_HAS_COROUTINE
+
+static const uint16_t kPort = 19777;
+static std::atomic<int> g_served{ 0 };
+
+static Task<size_t> readLine(CoConnection& c, std::string& out) {
+    for (;;) {
+        Buffer* b = co_await c.read(1);
+        if (!b) {
+            co_return 0;
+        }
+        const char* p = (const char*)memchr(b->peek(), '\n', b->readableBytes());
+        if (p) {
+            size_t n = p - b->peek() + 1;
+            out.assign(b->peek(), n);
+            b->retrieve(n);
+            co_return n;
+        }
+        co_await c.read(b->readableBytes() + 1);
+    }
+}
+
+static Task<void> echoSession(Connection::Ptr conn) {
+    co_await switchTo(conn->getThread());
+    CoConnection c(conn);
+    std::string line;
+    while (co_await readLine(c, line)) {
+        co_await sleep(conn->getThread(), 1);
+        if (!co_await c.write(line)) {
+            break;
+        }
+    }
+    g_served++;
+}
+
+static Task<void> echoServer(EventThread* thread, CoAcceptor* acceptor) {
+    co_await switchTo(thread);
+    acceptor->listen(INetAddress::fromIp4Port("127.0.0.1", kPort));
+    for (;;) {
+        Connection::Ptr conn = co_await acceptor->accept();
+        if (!conn) {
+            break;
+        }
+        spawn(echoSession(conn));
+    }
+}
+
+static bool echoRound(int round) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kPort);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        close(s);
+        return false;
+    }
+    int ok = 0;
+    for (int i = 0; i < 100; i++) {
+        char msg[32];
+        int n = snprintf(msg, sizeof(msg), "hello %d\n", i);
+        if (write(s, msg, n) != n) {
+            break;
+        }
+        char buf[64];
+        int got = 0;
+        while (got < n) {
+            int r = read(s, buf + got, sizeof(buf) - got);
+            if (r <= 0) {
+                break;
+            }
+            got += r;
+        }
+        if (got == n && memcmp(buf, msg, n) == 0) {
+            ok++;
+        }
+    }
+    close(s);
+    printf("conn %d echoed %d/100\n", round, ok);
+    return ok == 100;
+}
+
+static Task<void> sleeper(EventThread* thread, std::atomic<bool>* woke) {
+    co_await sleep(thread, 50);
+    *woke = true;
+}
+
+// 等待中的协程帧被销毁，timer不能再恢复它
+static bool destroyWhileSleeping(EventThread* thread) {
+    std::atomic<bool> woke{ false };
+    Task<void>* task = new Task<void>(sleeper(thread, &woke));
+    thread->dispatch([task]() {
+        task->await_suspend(std::noop_coroutine()).resume();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    thread->dispatch([task]() {
+        delete task;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    printf("sleeper woke after destroy: %d\n", (int)woke.load());
+    return !woke;
+}
+
+int main() {
+    EventThreadPool::instance().init(2);
+    EventThread* thread = EventThreadPool::instance().getThread(0);
+    CoAcceptor acceptor(thread);
+    spawn(echoServer(thread, &acceptor));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    bool ok = true;
+    for (int i = 0; i < 3; i++) {
+        ok = echoRound(i) && ok;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    thread->dispatch([&acceptor]() { acceptor.close(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    printf("served %d\n", g_served.load());
+    ok = g_served == 3 && ok;
+    ok = destroyWhileSleeping(thread) && ok;
+
+    fflush(stdout);
+    // 连接池和线程池没有完整的退出流程，直接结束进程
+    _exit(ok ? 0 : 1);
+}
+
+#else
+
+int main() {
+    printf("coroutine support requires C++20\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DispatchQueue.h"
+#include "TestUtil.h"
+
+using namespace DLNetwork;
+
+// 计数到0时唤醒等待方；等待带超时，出错时测试失败而不是挂住
+class Latch {
+public:
+    explicit Latch(int n) : _n(n) {}
+    void countDown() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (--_n == 0) {
+            _cv.notify_all();
+        }
+    }
+    bool wait() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        return _cv.wait_for(lock, std::chrono::seconds(10), [this] { return _n <= 0; });
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    int _n;
+};
+
+// 单工作线程：外部提交和工作线程内提交的任务都按提交顺序执行
+static void testSerialOrder() {
+    DispatchQueue q(1);
+    const int kTasks = 1000;
+    std::vector<int> order;
+    Latch done(kTasks + 3);
+    for (int i = 0; i < kTasks; ++i) {
+        q.dispatch([&order, &done, i]() {
+            order.push_back(i);
+            done.countDown();
+        });
+    }
+    q.dispatch([&q, &order, &done]() {
+        for (int i = 0; i < 3; ++i) {
+            q.dispatch([&order, &done, i]() {
+                order.push_back(kTasks + i);
+                done.countDown();
+            });
+        }
+    });
+    CHECK(done.wait());
+    CHECK(order.size() == size_t(kTasks + 3));
+    for (size_t i = 0; i < order.size(); ++i) {
+        CHECK(order[i] == int(i));
+    }
+}
+
+// 一个工作线程被占住，另一个执行外部任务，并偷走被占住线程队列里的外部任务，执行顺序与提交顺序一致
+static void testExternalFifo() {
+    DispatchQueue q(2);
+    Latch started(2);
+    Latch releaseX(1);
+    Latch releaseY(1);
+    q.dispatch([&]() { started.countDown(); CHECK(releaseX.wait()); });
+    q.dispatch([&]() { started.countDown(); CHECK(releaseY.wait()); });
+    CHECK(started.wait());
+
+    // 两个工作线程都占住时提交，外部任务轮流进入两个队列
+    const int kTasks = 200;
+    std::vector<int> order;
+    Latch done(kTasks);
+    for (int i = 0; i < kTasks; ++i) {
+        q.dispatch([&order, &done, i]() {
+            order.push_back(i);
+            done.countDown();
+        });
+    }
+    // 只放开一个，所有任务都由它执行
+    releaseX.countDown();
+    CHECK(done.wait());
+    releaseY.countDown();
+
+    CHECK(order.size() == size_t(kTasks));
+    int lastEven = -1;
+    int lastOdd = -1;
+    for (int v : order) {
+        int& last = v % 2 ? lastOdd : lastEven;
+        CHECK(v > last);
+        last = v;
+    }
+}
+
+// 工作线程不断派生本地任务时，它队列里的外部任务仍能很快执行
+static void testExternalNotStarved() {
+    DispatchQueue q(2);
+    const int kLimit = 100000;
+    // 占住一个工作线程，本地任务链只在另一个上跑
+    Latch started(1);
+    Latch release(1);
+    q.dispatch([&]() { started.countDown(); CHECK(release.wait()); });
+    CHECK(started.wait());
+
+    std::atomic<bool> externalRan{ false };
+    std::atomic<int> chainSteps{ 0 };
+    std::atomic<int> stepsWhenRan{ -1 };
+    Latch chainStarted(1);
+    Latch chainDone(1);
+    struct Chain {
+        static void step(DispatchQueue* q, std::atomic<bool>* ran, std::atomic<int>* steps, Latch* done) {
+            if (ran->load() || steps->fetch_add(1) >= kLimit) {
+                done->countDown();
+                return;
+            }
+            q->dispatch([q, ran, steps, done]() { step(q, ran, steps, done); });
+        }
+    };
+    q.dispatch([&]() {
+        chainStarted.countDown();
+        Chain::step(&q, &externalRan, &chainSteps, &chainDone);
+    });
+    CHECK(chainStarted.wait());
+    // 两个队列各放一个，其中一个落在执行任务链的工作线程上
+    Latch externalDone(2);
+    for (int i = 0; i < 2; ++i) {
+        q.dispatch([&]() {
+            if (!externalRan.exchange(true)) {
+                stepsWhenRan = chainSteps.load();
+            }
+            externalDone.countDown();
+        });
+    }
+    CHECK(chainDone.wait());
+    release.countDown();
+    CHECK(externalDone.wait());
+    CHECK(stepsWhenRan.load() >= 0 && stepsWhenRan.load() < kLimit);
+}
+
+// 工作线程被占住时，它派生的本地任务由其他工作线程偷走执行
+static void testSteal() {
+    DispatchQueue q(2);
+    std::thread::id parentThread;
+    std::thread::id childThread;
+    Latch childDone(1);
+    Latch parentDone(1);
+    q.dispatch([&]() {
+        parentThread = std::this_thread::get_id();
+        q.dispatch([&]() {
+            childThread = std::this_thread::get_id();
+            childDone.countDown();
+        });
+        // 子任务完成前不返回，只能被另一个工作线程偷走
+        CHECK(childDone.wait());
+        parentDone.countDown();
+    });
+    CHECK(parentDone.wait());
+    CHECK(childThread != std::thread::id());
+    CHECK(childThread != parentThread);
+}
+
+// 多工作线程下大量嵌套提交的任务全部执行且只执行一次
+static void testAllRun() {
+    DispatchQueue q(4);
+    const int kOuter = 200;
+    const int kInner = 50;
+    std::vector<std::atomic<int>> hits(kOuter * kInner);
+    Latch done(kOuter * kInner);
+    for (int i = 0; i < kOuter; ++i) {
+        q.dispatch([&, i]() {
+            CHECK(q.isCurrentThread());
+            for (int j = 0; j < kInner; ++j) {
+                q.dispatch([&, i, j]() {
+                    hits[i * kInner + j]++;
+                    done.countDown();
+                });
+            }
+        });
+    }
+    CHECK(done.wait());
+    for (auto& h : hits) {
+        CHECK(h.load() == 1);
+    }
+    CHECK(!q.isCurrentThread());
+}
+
+int main() {
+    testSerialOrder();
+    testExternalFifo();
+    testExternalNotStarved();
+    testSteal();
+    testAllRun();
+    return TEST_RESULT();
+}
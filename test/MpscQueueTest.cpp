@@ -0,0 +1,123 @@
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "MpscQueue.h"
+#include "TestUtil.h"
+
+using namespace DLNetwork;
+
+static void testFifo() {
+    MpscQueue<int> q;
+    int v = -1;
+    CHECK(!q.pop(v));
+    for (int i = 0; i < 1000; ++i) {
+        q.push(int(i));
+    }
+    for (int i = 0; i < 1000; ++i) {
+        CHECK(q.pop(v));
+        CHECK(v == i);
+    }
+    CHECK(!q.pop(v));
+}
+
+// 出队后节点里的值要及时析构
+static void testValueReleased() {
+    auto p = std::make_shared<int>(1);
+    MpscQueue<std::shared_ptr<int>> q;
+    q.push(std::shared_ptr<int>(p));
+    CHECK(p.use_count() == 2);
+    std::shared_ptr<int> out;
+    CHECK(q.pop(out));
+    out.reset();
+    CHECK(p.use_count() == 1);
+    q.push(std::shared_ptr<int>(p));
+    CHECK(p.use_count() == 2);
+}
+
+// 队列析构时释放未出队的元素
+static void testDestroyPending() {
+    auto p = std::make_shared<int>(1);
+    {
+        MpscQueue<std::shared_ptr<int>> q;
+        for (int i = 0; i < 10; ++i) {
+            q.push(std::shared_ptr<int>(p));
+        }
+    }
+    CHECK(p.use_count() == 1);
+}
+
+// 多生产者：总数不丢不重，同一生产者内部保持顺序
+static void testMultiProducer() {
+    const int kProducers = 4;
+    const int kPerProducer = 20000;
+    MpscQueue<int> q;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < kProducers; ++p) {
+        threads.emplace_back([&q, p]() {
+            for (int i = 0; i < kPerProducer; ++i) {
+                q.push(p * kPerProducer + i);
+            }
+        });
+    }
+    std::vector<int> next(kProducers, 0);
+    int got = 0;
+    int v;
+    while (got < kProducers * kPerProducer) {
+        if (!q.pop(v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int p = v / kPerProducer;
+        CHECK(p >= 0 && p < kProducers);
+        CHECK(v % kPerProducer == next[p]);
+        next[p] = v % kPerProducer + 1;
+        got++;
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    CHECK(!q.pop(v));
+    for (int p = 0; p < kProducers; ++p) {
+        CHECK(next[p] == kPerProducer);
+    }
+}
+
+// 生产者线程退出后其缓存节点被释放(由ASan/LSan检查)，队列继续可用
+static void testThreadExit() {
+    MpscQueue<int> q;
+    for (int round = 0; round < 8; ++round) {
+        std::thread t([&q]() {
+            for (int i = 0; i < 1000; ++i) {
+                q.push(int(i));
+            }
+        });
+        t.join();
+        int v;
+        for (int i = 0; i < 1000; ++i) {
+            CHECK(q.pop(v));
+            CHECK(v == i);
+        }
+        // 消费者线程的缓存超过上限，多出的节点归还或释放
+        std::thread c([]() {
+            MpscQueue<int> local;
+            for (int i = 0; i < 5000; ++i) {
+                local.push(int(i));
+            }
+            int x;
+            while (local.pop(x)) {
+            }
+        });
+        c.join();
+    }
+}
+
+int main() {
+    testFifo();
+    testValueReleased();
+    testDestroyPending();
+    testMultiProducer();
+    testThreadExit();
+    return TEST_RESULT();
+}
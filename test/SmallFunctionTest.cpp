@@ -0,0 +1,102 @@
+#include <memory>
+#include <string>
+#include <functional>
+
+#include "SmallFunction.h"
+#include "TestUtil.h"
+
+using namespace DLNetwork;
+
+// 返回值会被void签名丢弃
+static void testVoidDiscardsResult() {
+    int calls = 0;
+    SmallFunction<void(int)> f = [&calls](int x) { calls += x; return calls; };
+    f(2);
+    f(3);
+    CHECK(calls == 5);
+
+    SmallFunction<void()> g = []() { return std::string("ignored"); };
+    g();
+    CHECK(static_cast<bool>(g));
+}
+
+static void testInlineAndHeap() {
+    int sum = 0;
+    auto small = [&sum](int x) { sum += x; };
+    CHECK(SmallFunction<void(int)>::storedInline<decltype(small)>());
+    SmallFunction<void(int)> f = small;
+    f(1);
+    CHECK(sum == 1);
+
+    // 超过内联容量的捕获落到堆上
+    char pad[SmallFunction<int()>::inlineSize * 2] = { 7 };
+    auto big = [pad]() { return static_cast<int>(pad[0]); };
+    CHECK(!SmallFunction<int()>::storedInline<decltype(big)>());
+    SmallFunction<int()> h = big;
+    CHECK(h() == 7);
+
+    // 不可nothrow移动的也放堆上，仍然可用
+    SmallFunction<size_t()> s = [str = std::string(100, 'x')]() { return str.size(); };
+    CHECK(s() == 100);
+}
+
+static void testMoveOnly() {
+    auto p = std::make_unique<int>(42);
+    SmallFunction<int()> f = [p = std::move(p)]() { return *p; };
+    SmallFunction<int()> g = std::move(f);
+    CHECK(!f);
+    CHECK(g() == 42);
+    f = std::move(g);
+    CHECK(f() == 42);
+    CHECK(!g);
+}
+
+static void testDestroy() {
+    auto p = std::make_shared<int>(1);
+    {
+        SmallFunction<void()> f = [p]() {};
+        CHECK(p.use_count() == 2);
+        f = nullptr;
+        CHECK(p.use_count() == 1);
+        f = [p]() {};
+        CHECK(p.use_count() == 2);
+    }
+    CHECK(p.use_count() == 1);
+}
+
+static int plusOne(int x) { return x + 1; }
+
+static void testEmptyAndType() {
+    SmallFunction<void()> f;
+    CHECK(f == nullptr);
+    CHECK(f.target_type() == typeid(void));
+    bool thrown = false;
+    try {
+        f();
+    }
+    catch (const std::bad_function_call&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+
+    // 空函数指针/空std::function构造出空对象
+    int (*fp)(int) = nullptr;
+    SmallFunction<int(int)> a = fp;
+    CHECK(!a);
+    SmallFunction<int(int)> b = std::function<int(int)>();
+    CHECK(!b);
+
+    SmallFunction<int(int)> c = &plusOne;
+    CHECK(c != nullptr);
+    CHECK(c(1) == 2);
+    CHECK(c.target_type() == typeid(int (*)(int)));
+}
+
+int main() {
+    testVoidDiscardsResult();
+    testInlineAndHeap();
+    testMoveOnly();
+    testDestroy();
+    testEmptyAndType();
+    return TEST_RESULT();
+}
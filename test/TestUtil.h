@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdio.h>
+
+// 单元测试用的最小断言，失败时打印位置并计数，main用TEST_RESULT()作为返回值
+namespace DLNetwork {
+namespace test {
+inline int& failures() {
+    static int n = 0;
+    return n;
+}
+} // namespace test
+} // namespace DLNetwork
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            DLNetwork::test::failures()++; \
+        } \
+    } while (0)
+
+#define TEST_RESULT() (DLNetwork::test::failures() ? 1 : 0)
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "TimerManager.h"
+#include "TestUtil.h"
+
+using namespace DLNetwork;
+
+// 像EventThread一样按processAllTimeout返回的间隔驱动时间轮，直到done()成立或超时
+template<typename Pred>
+static bool runUntil(TimerManager& m, Pred done, unsigned maxMs = 5000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(maxMs);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        unsigned long long next = m.processAllTimeout();
+        if (done()) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(next ? std::min<unsigned long long>(next, 10) : 1));
+    }
+    return true;
+}
+
+struct Fired {
+    int tag;
+    unsigned long long atMs;
+};
+
+// 超过第一层(256ms)的timer挂在上层，转过圈边界时cascade下来，按到期顺序触发且不会提前
+static void testCascade() {
+    TimerManager m;
+    std::vector<Fired> fired;
+    const unsigned timeouts[] = { 600, 300, 270, 5, 0, 257 };
+    unsigned long long start = m.getCurrentMillisecs();
+    for (unsigned t : timeouts) {
+        m.addTimer(t, [&fired, &m, t](void*) {
+            fired.push_back(Fired{ (int)t, m.getCurrentMillisecs() });
+            return 0;
+        });
+    }
+    TimerId far = m.addTimer(60000, [](void*) { return 0; });
+    CHECK(m.size() == 7);
+    CHECK(runUntil(m, [&] { return fired.size() == 6; }));
+    CHECK(fired.size() == 6);
+    for (size_t i = 0; i < fired.size(); ++i) {
+        CHECK(fired[i].atMs >= start + fired[i].tag);
+        if (i > 0) {
+            CHECK(fired[i].tag > fired[i - 1].tag);
+        }
+    }
+    CHECK(m.size() == 1);
+    CHECK(m.delTimer(far));
+    CHECK(m.size() == 0);
+}
+
+// 已触发/已删除的句柄对复用同一个Timer对象的新timer没有影响
+static void testStaleId() {
+    TimerManager m;
+    int first = 0;
+    TimerId id = m.addTimer(1, [&first](void*) { first++; return 0; });
+    CHECK(runUntil(m, [&] { return first == 1; }));
+    CHECK(!m.delTimer(id));
+    CHECK(!m.resetTimer(id, 10));
+
+    int second = 0;
+    TimerId id2 = m.addTimer(1, [&second](void*) { second++; return 0; });
+    CHECK(id2.timer == id.timer);
+    CHECK(id2.seq != id.seq);
+    CHECK(id2 != id);
+    CHECK(!m.delTimer(id));
+    CHECK(!m.resetTimer(id, 1000));
+    CHECK(runUntil(m, [&] { return second == 1; }));
+    CHECK(first == 1);
+
+    TimerId id3 = m.addTimer(1000, [](void*) { return 0; });
+    CHECK(m.delTimer(id3));
+    CHECK(!m.delTimer(id3));
+    CHECK(!m.resetTimer(id3, 1));
+    CHECK(m.size() == 0);
+}
+
+// 重置把到期时间推后，回调返回值作为下次间隔，回调中可删除自己
+static void testResetAndRepeat() {
+    TimerManager m;
+    int fires = 0;
+    unsigned long long start = m.getCurrentMillisecs();
+    unsigned long long at = 0;
+    TimerId id = m.addTimer(20, [&](void*) { fires++; at = m.getCurrentMillisecs(); return 0; });
+    CHECK(m.resetTimer(id, 120));
+    CHECK(runUntil(m, [&] { return fires == 1; }));
+    CHECK(at >= start + 120);
+
+    int repeats = 0;
+    TimerId self;
+    self = m.addTimer(2, [&](void*) {
+        if (++repeats == 5) {
+            CHECK(m.delTimer(self));
+        }
+        return 2;
+    });
+    CHECK(runUntil(m, [&] { return repeats == 5; }));
+    m.processAllTimeout();
+    CHECK(repeats == 5);
+    CHECK(m.size() == 0);
+    CHECK(!m.delTimer(self));
+}
+
+// 高精度timer按微秒到期时间排序，不会提前触发
+static void testPrecise() {
+    TimerManager m;
+    std::vector<int> order;
+    std::vector<bool> early;
+    const int timeoutsUs[] = { 3000, 1000, 2000, 1500 };
+    for (int us : timeoutsUs) {
+        unsigned long long expire = m.getCurrentMicrosecs() + us;
+        m.addTimer(std::chrono::microseconds(us), [&order, &early, &m, us, expire](void*) {
+            order.push_back(us);
+            early.push_back(m.getCurrentMicrosecs() < expire);
+            return 0;
+        });
+    }
+    int repeats = 0;
+    m.addTimer(std::chrono::microseconds(500), [&repeats](void*) { return ++repeats < 3 ? 500 : 0; });
+    CHECK(m.nextPreciseExpire() > 0);
+    CHECK(runUntil(m, [&] { return order.size() == 4 && repeats == 3; }));
+    CHECK(std::is_sorted(order.begin(), order.end()));
+    CHECK(std::find(early.begin(), early.end(), true) == early.end());
+    CHECK(m.size() == 0);
+    CHECK(m.nextPreciseExpire() == 0);
+
+    // 高精度timer同样可以重置和删除
+    int fired = 0;
+    TimerId id = m.addTimer(std::chrono::microseconds(100), [&fired](void*) { fired++; return 0; });
+    CHECK(m.resetTimer(id, std::chrono::microseconds(200000)));
+    TimerId other = m.addTimer(std::chrono::microseconds(100), [](void*) { return 0; });
+    CHECK(runUntil(m, [&] { return m.size() == 1; }));
+    CHECK(fired == 0);
+    CHECK(m.delTimer(id));
+    CHECK(!m.delTimer(other));
+    CHECK(m.size() == 0);
+}
+
+// 跨线程先建Timer再加入：加入前按序号cancel的直接回收，不会触发
+static void testCancelBeforeAdd() {
+    TimerManager m;
+    int fired = 0;
+    Timer* t = new Timer(0, [&fired](void*) { fired++; return 0; }, nullptr);
+    TimerId id(t);
+    t->cancel(id.seq);
+    m.addTimer(t, 1);
+    CHECK(m.size() == 0);
+    CHECK(!m.delTimer(id));
+
+    Timer* t2 = new Timer(0, [&fired](void*) { fired++; return 0; }, nullptr);
+    TimerId id2(t2);
+    // 过期的序号不影响
+    t2->cancel(id2.seq - 1);
+    m.addTimer(t2, 1);
+    CHECK(runUntil(m, [&] { return fired == 1; }));
+    CHECK(fired == 1);
+}
+
+int main() {
+    testCascade();
+    testStaleId();
+    testResetAndRepeat();
+    testPrecise();
+    testCancelBeforeAdd();
+    return TEST_RESULT();
+}
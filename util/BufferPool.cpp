@@ -0,0 +1,107 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "BufferPool.h"
+
+using namespace DLNetwork;
+
+static thread_local BufferPool* t_pool = nullptr;
+
+BufferPool::~BufferPool() {
+    for (int c = 0; c < kClasses; c++) {
+        while (Block* b = _free[c]) {
+            _free[c] = b->next;
+            ::operator delete(b);
+        }
+    }
+}
+
+BufferPool* BufferPool::current() {
+    return t_pool;
+}
+
+void BufferPool::setCurrent(BufferPool* pool) {
+    t_pool = pool;
+}
+
+void* BufferPool::allocBlock(size_t n) {
+    if (t_pool) {
+        return t_pool->allocate(n);
+    }
+    return ::operator new(n <= kMaxBlock ? classSize(classOf(n)) : n);
+}
+
+void BufferPool::freeBlock(void* p, size_t n) noexcept {
+    if (t_pool) {
+        t_pool->deallocate(p, n);
+        return;
+    }
+    ::operator delete(p);
+}
+
+void* BufferPool::allocate(size_t n) {
+    if (n > kMaxBlock) {
+        _oversize.store(_oversize.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return ::operator new(n);
+    }
+    int c = classOf(n);
+    if (Block* b = _free[c]) {
+        _free[c] = b->next;
+        _retained.store(_retained.load(std::memory_order_relaxed) - classSize(c), std::memory_order_relaxed);
+        _hits.store(_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return b;
+    }
+    _misses.store(_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return ::operator new(classSize(c));
+}
+
+void BufferPool::deallocate(void* p, size_t n) noexcept {
+    if (!p) {
+        return;
+    }
+    if (n > kMaxBlock) {
+        ::operator delete(p);
+        return;
+    }
+    int c = classOf(n);
+    size_t retained = _retained.load(std::memory_order_relaxed);
+    if (retained + classSize(c) > _maxRetained) {
+        _released.store(_released.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        ::operator delete(p);
+        return;
+    }
+    Block* b = static_cast<Block*>(p);
+    b->next = _free[c];
+    _free[c] = b;
+    _retained.store(retained + classSize(c), std::memory_order_relaxed);
+}
+
+BufferPoolStats BufferPool::stats() const {
+    BufferPoolStats s;
+    s.hits = _hits.load(std::memory_order_relaxed);
+    s.misses = _misses.load(std::memory_order_relaxed);
+    s.oversize = _oversize.load(std::memory_order_relaxed);
+    s.released = _released.load(std::memory_order_relaxed);
+    s.retainedBytes = _retained.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+
+namespace DLNetwork {
+
+struct BufferPoolStats {
+	uint64_t hits;          // 从空闲链表取到的次数
+	uint64_t misses;        // 空闲链表为空，向系统分配的次数
+	uint64_t oversize;      // 超过最大块，直接向系统分配的次数
+	uint64_t released;      // 超过保留上限，直接还给系统的次数
+	size_t retainedBytes;   // 空闲链表中保留的字节数
+	double hitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+};
+
+/// 按2的幂分级(64B~64KB)的内存块池，给Buffer等频繁创建释放的缓冲区用
+/// 每个EventThread一个，只在所属线程分配和回收，不加锁；统计可在任意线程读取
+/// 池中的块都是按级别大小operator new出来的，所以在哪个线程释放都可以，
+/// 没有池的线程直接向系统分配释放，其他线程释放的块进入释放线程的池
+class BufferPool
+{
+public:
+	static const size_t kMinBlock = 64;
+	static const size_t kMaxBlock = 64 * 1024;
+	static const int kClasses = 11;
+	static const size_t kDefaultMaxRetained = 8 * 1024 * 1024;
+
+	explicit BufferPool(size_t maxRetainedBytes = kDefaultMaxRetained) : _maxRetained(maxRetainedBytes) {}
+	~BufferPool();
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+
+	void* allocate(size_t n);
+	void deallocate(void* p, size_t n) noexcept;
+	BufferPoolStats stats() const;
+	void setMaxRetained(size_t bytes) { _maxRetained = bytes; }
+
+	// 当前线程使用的池，未设置时为nullptr
+	static BufferPool* current();
+	// 由EventThread在loop线程开始和结束时设置
+	static void setCurrent(BufferPool* pool);
+	// 用当前线程的池分配，没有池时按相同的级别大小向系统分配
+	static void* allocBlock(size_t n);
+	static void freeBlock(void* p, size_t n) noexcept;
+
+private:
+	struct Block {
+		Block* next;
+	};
+
+	static int classOf(size_t n) {
+		size_t size = kMinBlock;
+		int c = 0;
+		while (size < n) {
+			size <<= 1;
+			c++;
+		}
+		return c;
+	}
+	static size_t classSize(int c) { return kMinBlock << c; }
+
+	Block* _free[kClasses] = {};
+	size_t _maxRetained;
+	std::atomic<size_t> _retained{ 0 };
+	std::atomic<uint64_t> _hits{ 0 };
+	std::atomic<uint64_t> _misses{ 0 };
+	std::atomic<uint64_t> _oversize{ 0 };
+	std::atomic<uint64_t> _released{ 0 };
+};
+
+// 从当前线程的BufferPool分配的标准库分配器
+template<typename T>
+struct PoolAllocator {
+	using value_type = T;
+
+	PoolAllocator() noexcept {}
+	template<typename U>
+	PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+	T* allocate(size_t n) {
+		return static_cast<T*>(BufferPool::allocBlock(n * sizeof(T)));
+	}
+	void deallocate(T* p, size_t n) noexcept {
+		BufferPool::freeBlock(p, n * sizeof(T));
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return true; }
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) noexcept { return false; }
+
+} // namespace DLNetwork
@@ -0,0 +1,163 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "CpuTopology.h"
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <set>
+#include <algorithm>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+using namespace DLNetwork;
+
+#if defined(__linux__)
+// 解析"0-3,8,10-11"格式的cpu/node列表
+static std::vector<int> parseList(const std::string& str) {
+    std::vector<int> ret;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty() || !isdigit((unsigned char)item[0])) {
+            continue;
+        }
+        size_t dash = item.find('-');
+        int first = std::stoi(item.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+        for (int i = first; i <= last; i++) {
+            ret.push_back(i);
+        }
+    }
+    return ret;
+}
+
+static std::string readLine(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+static int readInt(const std::string& path, int def) {
+    std::string line = readLine(path);
+    if (line.empty() || !(isdigit((unsigned char)line[0]) || line[0] == '-')) {
+        return def;
+    }
+    return std::stoi(line);
+}
+#endif
+
+std::vector<CpuInfo> CpuTopology::detect() {
+    std::vector<CpuInfo> cpus;
+#if defined(__linux__)
+    const std::string cpuDir = "/sys/devices/system/cpu/";
+    std::map<int, int> cpuNode;
+    for (int node : parseList(readLine("/sys/devices/system/node/online"))) {
+        for (int cpu : parseList(readLine("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))) {
+            cpuNode[cpu] = node;
+        }
+    }
+    for (int cpu : parseList(readLine(cpuDir + "online"))) {
+        std::string topo = cpuDir + "cpu" + std::to_string(cpu) + "/topology/";
+        CpuInfo info;
+        info.cpu = cpu;
+        info.core = readInt(topo + "core_id", cpu);
+        info.package = readInt(topo + "physical_package_id", 0);
+        auto it = cpuNode.find(cpu);
+        info.node = it == cpuNode.end() ? 0 : it->second;
+        cpus.push_back(info);
+    }
+#endif
+    if (cpus.empty()) {
+        int n = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 0; i < n; i++) {
+            cpus.push_back(CpuInfo{ i, i, 0, 0 });
+        }
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> CpuTopology::spread(int n) {
+    std::vector<std::vector<int>> ret;
+    if (n <= 0) {
+        return ret;
+    }
+    // 每个节点内的CPU排序：先是每个物理核的第一个CPU，再是其余超线程
+    std::map<int, std::vector<int>> nodeCpus;
+    std::map<int, std::set<std::pair<int, int>>> usedCores;
+    std::map<int, std::vector<int>> siblings;
+    for (auto& info : detect()) {
+        if (usedCores[info.node].insert(std::make_pair(info.package, info.core)).second) {
+            nodeCpus[info.node].push_back(info.cpu);
+        }
+        else {
+            siblings[info.node].push_back(info.cpu);
+        }
+    }
+    size_t total = 0;
+    for (auto& item : nodeCpus) {
+        auto& sib = siblings[item.first];
+        item.second.insert(item.second.end(), sib.begin(), sib.end());
+        total += item.second.size();
+    }
+    // 节点之间轮流取，线程比CPU多时从头复用
+    std::vector<int> order;
+    for (size_t i = 0; order.size() < total; i++) {
+        for (auto& item : nodeCpus) {
+            if (i < item.second.size()) {
+                order.push_back(item.second[i]);
+            }
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        ret.push_back(std::vector<int>{ order[i % order.size()] });
+    }
+    return ret;
+}
+
+int CpuTopology::nodeOfCpu(int cpu) {
+    for (auto& info : detect()) {
+        if (info.cpu == cpu) {
+            return info.node;
+        }
+    }
+    return 0;
+}
+
+bool CpuTopology::preferMemoryNode(int node) {
+#if defined(__linux__)
+    if (node < 0 || node >= (int)(sizeof(unsigned long) * 8)) {
+        return false;
+    }
+    unsigned long mask = 1UL << node;
+    return syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) == 0;
+#else
+    return false;
+#endif
+}
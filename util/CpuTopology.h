@@ -0,0 +1,48 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <vector>
+
+namespace DLNetwork {
+
+struct CpuInfo {
+    int cpu;
+    int core;    // 同一物理核上的超线程core相同
+    int package;
+    int node;    // NUMA节点
+};
+
+// CPU/NUMA拓扑，Linux下读取/sys，其他平台视为单节点、每个CPU一个核
+class CpuTopology {
+public:
+    static std::vector<CpuInfo> detect();
+    // 给n个线程各分配一个CPU：各NUMA节点轮流分配，节点内先用不同的物理核，再用超线程
+    static std::vector<std::vector<int>> spread(int n);
+    // 返回cpu所在的NUMA节点，未知时返回0
+    static int nodeOfCpu(int cpu);
+    // 当前线程之后分配的内存优先来自node(set_mempolicy MPOL_PREFERRED)，仅Linux
+    static bool preferMemoryNode(int node);
+};
+
+} //DLNetwork
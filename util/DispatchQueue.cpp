@@ -23,12 +23,22 @@
  */
 #include "DispatchQueue.h"
 #include "ThreadName.h"
-#include <atomic>
+#include <stdio.h>
+#include <algorithm>
 
 using namespace DLNetwork;
 
-DispatchQueue::DispatchQueue():_stop(false),_thread(nullptr)
+namespace {
+// 当前线程所属的队列及其工作线程下标
+thread_local DispatchQueue* tlsQueue = nullptr;
+thread_local size_t tlsWorker = 0;
+}
+
+DispatchQueue::DispatchQueue(size_t workerCount):_workerCount(workerCount),_stop(false)
 {
+	if (_workerCount == 0) {
+		_workerCount = std::max(1u, std::thread::hardware_concurrency());
+	}
 	start();
 }
 
@@ -40,7 +50,8 @@ DispatchQueue::~DispatchQueue()
 
 DispatchQueue * DispatchQueue::globalQueue()
 {
-	static DispatchQueue _queue;
+	// 保持原来的单线程串行语义，依赖任务按提交顺序执行的调用方不受影响
+	static DispatchQueue _queue(1);
 	//static std::once_flag once;
 	//std::call_once(once, []() {
 	//	_queue.start();
@@ -49,57 +60,138 @@ DispatchQueue * DispatchQueue::globalQueue()
 	return &_queue;;
 }
 
+DispatchQueue * DispatchQueue::workerPool()
+{
+	static DispatchQueue _pool;
+	return &_pool;
+}
+
 void DispatchQueue::start()
 {
-    static std::atomic<int> n(1);
-    char buf[64];
-    snprintf(buf, sizeof(buf), "DispatchQueue %d", n.load(std::memory_order_acquire));
-    n++;
-	_thread = new std::thread(&DispatchQueue::runloop, this);
-    setThreadName(_thread, buf);
-	_selfThreadid = _thread->get_id();
+	if (!_workers.empty()) {
+		return;
+	}
+	_stop = false;
+	static std::atomic<int> n(1);
+	int id = n.fetch_add(1);
+	for (size_t i = 0; i < _workerCount; i++) {
+		_workers.emplace_back(new Worker());
+	}
+	// 先建好所有队列再启动线程，偷任务时会遍历_workers
+	for (size_t i = 0; i < _workerCount; i++) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "DispatchQueue %d-%d", id, (int)i);
+		_workers[i]->thread = std::thread(&DispatchQueue::runloop, this, i);
+		setThreadName(&_workers[i]->thread, buf);
+	}
 }
 
 void DispatchQueue::stop()
 {
-	_stop = true;
-	if (_thread)
 	{
-		_thread->join();
-		delete _thread;
-		_thread = nullptr;
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	for (auto& worker : _workers) {
+		if (worker->thread.joinable()) {
+			worker->thread.join();
+		}
 	}
+	_workers.clear();
+	_queued = 0;
 }
 
-void DispatchQueue::dispatch(const TASK_FUN & task)
+bool DispatchQueue::isCurrentThread()
 {
-	std::unique_lock<std::mutex> lock(_mutex);
-	_taskqueue.push(task);
-	lock.unlock();
-	_cv.notify_all();
+	return tlsQueue == this;
 }
 
 void DispatchQueue::dispatch(TASK_FUN &&task)
 {
-	std::unique_lock<std::mutex> lock(_mutex);
-	_taskqueue.emplace(task);
-	lock.unlock();
-	_cv.notify_all();
+	if (_workers.empty()) {
+		return;
+	}
+	// 单工作线程时全部走外部队列，保持提交顺序
+	bool local = tlsQueue == this && _workers.size() > 1;
+	size_t index = local ? tlsWorker : _nextWorker.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+	Worker& worker = *_workers[index];
+	// 先计数再入队，工作线程取到任务后的减一不会先于这里的加一，_queued不会下溢。
+	// 与runloop中先增加_idle再检查_queued配对，两边至少有一方能看到对方
+	_queued.fetch_add(1);
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		(local ? worker.tasks : worker.inject).push_back(std::move(task));
+	}
+	if (_idle.load() > 0) {
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_cv.notify_one();
+	}
 }
 
-void DispatchQueue::runloop()
+bool DispatchQueue::popFront(std::deque<TASK_FUN>& tasks, TASK_FUN& task)
 {
-	while (!_stop)
-	{
-		std::unique_lock<std::mutex> lk(_mutex);
-		_cv.wait_for(lk, std::chrono::duration<int, std::milli>(10), [this] {return _taskqueue.size() > 0; });
-		if (_stop) break;
+	if (tasks.empty()) {
+		return false;
+	}
+	task = std::move(tasks.front());
+	tasks.pop_front();
+	return true;
+}
 
-		if (_taskqueue.size() <= 0) continue;
-		TASK_FUN task = std::move(_taskqueue.front());
-		_taskqueue.pop();
-		lk.unlock();
+bool DispatchQueue::popTask(size_t index, TASK_FUN& task)
+{
+	// 先取自己的队列：本地任务取尾部，外部任务取头部，隔一段先取一次外部任务
+	{
+		Worker& self = *_workers[index];
+		std::lock_guard<std::mutex> lock(self.mutex);
+		bool injectFirst = ++self.pops % kInjectInterval == 0;
+		if (injectFirst && popFront(self.inject, task)) {
+			return true;
+		}
+		if (!self.tasks.empty()) {
+			task = std::move(self.tasks.back());
+			self.tasks.pop_back();
+			return true;
+		}
+		if (popFront(self.inject, task)) {
+			return true;
+		}
+	}
+	// 再从其他工作线程队列头部偷，先偷等得最久的外部任务
+	size_t count = _workers.size();
+	for (size_t i = 1; i < count; i++) {
+		Worker& victim = *_workers[(index + i) % count];
+		std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+		if (lock.owns_lock() && (popFront(victim.inject, task) || popFront(victim.tasks, task))) {
+			return true;
+		}
+	}
+	return false;
+}
 
-		task();
+void DispatchQueue::runloop(size_t index)
+{
+	tlsQueue = this;
+	tlsWorker = index;
+	TASK_FUN task;
+	while (!_stop)
+	{
+		if (popTask(index, task)) {
+			_queued.fetch_sub(1);
+			task();
+			task = nullptr;
+			continue;
+		}
+		if (_queued.load() > 0) {
+			// 有任务但try_lock没抢到，让一下再试
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lk(_sleepMutex);
+		_idle.fetch_add(1);
+		_cv.wait(lk, [this] { return _stop || _queued.load() > 0; });
+		_idle.fetch_sub(1);
 	}
+	tlsQueue = nullptr;
 }
@@ -23,41 +23,67 @@
  */
 #pragma once
 
-#include <queue>
+#include <deque>
+#include <vector>
+#include <memory>
 #include <mutex>
+#include <atomic>
 #include <functional>
 #include <thread>
 #include <condition_variable>
+#include "SmallFunction.h"
 
 namespace DLNetwork {
+
+/// 多工作线程的任务队列，每个工作线程有自己的本地队列和外部队列：
+/// 工作线程内dispatch的任务压入自己本地队列尾部并从尾部取(LIFO，缓存友好)，
+/// 外部线程dispatch的任务轮流放入各工作线程的外部队列，按提交顺序(FIFO)执行，
+/// 工作线程每取kInjectInterval个任务至少看一次外部队列，本地任务不断派生时外部任务也不会饿死。
+/// 空闲的工作线程从别人队列头部偷任务。只有一个工作线程时任务按提交顺序串行执行
 class DispatchQueue
 {
-	using TASK_FUN = std::function<void(void)>;
 public:
-	DispatchQueue();
+	using TASK_FUN = SmallFunction<void(void)>;
+
+	// workerCount为0时使用CPU核数
+	explicit DispatchQueue(size_t workerCount = 0);
 	virtual ~DispatchQueue();
+	// 单工作线程，任务按提交顺序串行执行
 	static DispatchQueue* globalQueue();
+	// 每个CPU核一个工作线程，任务并行执行、不保证顺序，EventThread::offload默认用它
+	static DispatchQueue* workerPool();
 
 	void start();
 	void stop();
-	void dispatch(const TASK_FUN& task);
-	// dispatch and move
 	void dispatch(TASK_FUN&& task);
-	bool isCurrentThread() {
-		auto id = std::this_thread::get_id();
-		return _selfThreadid == id;
-	}
+	// 当前线程是否为本队列的工作线程
+	bool isCurrentThread();
+	size_t workerCount() const { return _workers.size(); }
 
 private:
-	void runloop();
+	struct Worker {
+		std::mutex mutex;
+		std::deque<TASK_FUN> tasks;  // 本工作线程dispatch的任务
+		std::deque<TASK_FUN> inject; // 外部线程dispatch的任务
+		unsigned pops = 0;           // 只由所属工作线程访问
+		std::thread thread;
+	};
+	static const unsigned kInjectInterval = 32;
+
+	void runloop(size_t index);
+	bool popTask(size_t index, TASK_FUN& task);
+	static bool popFront(std::deque<TASK_FUN>& tasks, TASK_FUN& task);
 
-	std::thread* _thread;
-	std::thread::id _selfThreadid;
-	std::mutex _mutex;
+	size_t _workerCount;
+	std::vector<std::unique_ptr<Worker>> _workers;
+	std::atomic<size_t> _nextWorker{ 0 };
+	// 所有队列中的任务总数，以及正在等待的工作线程数，用来决定是否需要唤醒
+	std::atomic<size_t> _queued{ 0 };
+	std::atomic<size_t> _idle{ 0 };
+	std::mutex _sleepMutex;
 	std::condition_variable _cv;
-	std::queue<TASK_FUN> _taskqueue;
-	bool _stop;
+	std::atomic<bool> _stop;
 };
 } //DLNetwork
 
-#define DELETE_THIS_LATER DispatchQueue::globalQueue()->aync([this]() {delete this; })
+#define DELETE_THIS_LATER DispatchQueue::globalQueue()->dispatch([this]() {delete this; })
@@ -0,0 +1,110 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+#include <atomic>
+#include <stdint.h>
+
+namespace DLNetwork {
+
+/// 按2的幂分桶的直方图，第i个桶统计[2^(i-1), 2^i)，0记在第0个桶
+/// 只能有一个线程record，其他线程可随时读，读到的是近似快照
+class LatencyHistogram
+{
+public:
+	static const int kBuckets = 40;
+
+	void record(uint64_t v) {
+		int b = bucketOf(v);
+		// 单写者，不需要原子的读-改-写
+		_buckets[b].store(_buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		_sum.store(_sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+		if (v > _max.load(std::memory_order_relaxed)) {
+			_max.store(v, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+	uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+	uint64_t mean() const {
+		uint64_t n = count();
+		return n ? _sum.load(std::memory_order_relaxed) / n : 0;
+	}
+	uint64_t bucket(int i) const { return _buckets[i].load(std::memory_order_relaxed); }
+
+	// p为0~1，返回所在桶的上界(不超过max)，没有数据时返回0
+	uint64_t percentile(double p) const {
+		uint64_t n = count();
+		if (n == 0) {
+			return 0;
+		}
+		uint64_t target = (uint64_t)(p * n);
+		if (target == 0) {
+			target = 1;
+		}
+		uint64_t seen = 0;
+		for (int i = 0; i < kBuckets; i++) {
+			seen += bucket(i);
+			if (seen >= target) {
+				uint64_t upper = i == 0 ? 0 : (1ULL << i) - 1;
+				return upper < max() ? upper : max();
+			}
+		}
+		return max();
+	}
+
+	// 与record并发调用时可能漏掉少量计数
+	void reset() {
+		for (auto& b : _buckets) {
+			b.store(0, std::memory_order_relaxed);
+		}
+		_count.store(0, std::memory_order_relaxed);
+		_sum.store(0, std::memory_order_relaxed);
+		_max.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	static int bucketOf(uint64_t v) {
+		if (v == 0) {
+			return 0;
+		}
+#if defined(__GNUC__)
+		int b = 64 - __builtin_clzll(v);
+#else
+		int b = 0;
+		while (v) {
+			v >>= 1;
+			b++;
+		}
+#endif
+		return b < kBuckets ? b : kBuckets - 1;
+	}
+
+	std::atomic<uint64_t> _buckets[kBuckets] = {};
+	std::atomic<uint64_t> _count{ 0 };
+	std::atomic<uint64_t> _sum{ 0 };
+	std::atomic<uint64_t> _max{ 0 };
+};
+
+} // ns DLNetwork
@@ -0,0 +1,191 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace DLNetwork {
+
+/// 无锁多生产者单消费者队列(Dmitry Vyukov的节点式MPSC队列)
+/// push可在任意线程调用，元素直接存放在节点内；pop只能在消费者线程调用
+/// 节点经线程本地缓存和全局回收栈复用，稳态下push/pop不再分配内存
+template<typename T>
+class MpscQueue
+{
+	struct Node {
+		std::atomic<Node*> next{ nullptr };
+		T value;
+	};
+
+	// 每线程缓存的空闲节点，超过上限分出一半归还到全局回收栈
+	struct NodeCache {
+		Node* head = nullptr;
+		size_t count = 0;
+		~NodeCache();
+	};
+	static const size_t kCacheMax = 256;
+	static const size_t kSharedMax = 4096;
+
+public:
+	MpscQueue() : _head(allocNode()), _tail(_head.load(std::memory_order_relaxed)) {}
+	~MpscQueue() {
+		T tmp;
+		while (pop(tmp)) {
+		}
+		freeNode(_tail);
+	}
+	MpscQueue(const MpscQueue&) = delete;
+	MpscQueue& operator=(const MpscQueue&) = delete;
+
+	void push(T&& value) {
+		Node* node = allocNode();
+		node->value = std::move(value);
+		Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// 某个生产者正处于push中间时可能暂时返回false，调用方需自行记账后重试
+	bool pop(T& value) {
+		Node* tail = _tail;
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (!next) {
+			return false;
+		}
+		value = std::move(next->value);
+		_tail = next;
+		freeNode(tail);
+		return true;
+	}
+
+private:
+	static std::atomic<Node*>& sharedFree() {
+		static std::atomic<Node*> head{ nullptr };
+		return head;
+	}
+	// 全局回收栈中节点数的近似值，压入前先占额度，超过kSharedMax的节点直接释放
+	static std::atomic<size_t>& sharedCount() {
+		static std::atomic<size_t> count{ 0 };
+		return count;
+	}
+	// NodeCache析构后仍可能有队列在本线程释放节点，此时直接delete
+	static bool& cacheDead() {
+		static thread_local bool dead = false;
+		return dead;
+	}
+	static NodeCache& localCache() {
+		static thread_local NodeCache cache;
+		return cache;
+	}
+	static void deleteList(Node* list) {
+		while (list) {
+			Node* n = list->next.load(std::memory_order_relaxed);
+			delete list;
+			list = n;
+		}
+	}
+	// 只做整链压入，取出时整栈exchange，没有ABA问题
+	static void pushShared(Node* first, Node* last, size_t n) {
+		std::atomic<size_t>& count = sharedCount();
+		if (count.fetch_add(n, std::memory_order_relaxed) + n > kSharedMax) {
+			count.fetch_sub(n, std::memory_order_relaxed);
+			last->next.store(nullptr, std::memory_order_relaxed);
+			deleteList(first);
+			return;
+		}
+		std::atomic<Node*>& shared = sharedFree();
+		Node* old = shared.load(std::memory_order_relaxed);
+		do {
+			last->next.store(old, std::memory_order_relaxed);
+		} while (!shared.compare_exchange_weak(old, first, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	static Node* allocNode() {
+		if (!cacheDead()) {
+			NodeCache& cache = localCache();
+			if (!cache.head) {
+				Node* list = sharedFree().exchange(nullptr, std::memory_order_acquire);
+				size_t taken = 0;
+				while (list) {
+					Node* n = list->next.load(std::memory_order_relaxed);
+					list->next.store(cache.head, std::memory_order_relaxed);
+					cache.head = list;
+					cache.count++;
+					taken++;
+					list = n;
+				}
+				if (taken) {
+					sharedCount().fetch_sub(taken, std::memory_order_relaxed);
+				}
+			}
+			if (cache.head) {
+				Node* node = cache.head;
+				cache.head = node->next.load(std::memory_order_relaxed);
+				cache.count--;
+				node->next.store(nullptr, std::memory_order_relaxed);
+				return node;
+			}
+		}
+		return new Node();
+	}
+
+	static void freeNode(Node* node) {
+		if (cacheDead()) {
+			delete node;
+			return;
+		}
+		node->value = T();
+		NodeCache& cache = localCache();
+		node->next.store(cache.head, std::memory_order_relaxed);
+		cache.head = node;
+		if (++cache.count > kCacheMax) {
+			// 本线程留一半，另一半交给全局回收栈
+			Node* last = cache.head;
+			size_t n = 1;
+			while (n < cache.count - kCacheMax / 2) {
+				last = last->next.load(std::memory_order_relaxed);
+				n++;
+			}
+			Node* first = cache.head;
+			cache.head = last->next.load(std::memory_order_relaxed);
+			cache.count -= n;
+			pushShared(first, last, n);
+		}
+	}
+
+	alignas(64) std::atomic<Node*> _head; // 生产者端
+	alignas(64) Node* _tail;              // 消费者端
+};
+
+template<typename T>
+MpscQueue<T>::NodeCache::~NodeCache() {
+	// 线程退出时释放本线程缓存的节点
+	cacheDead() = true;
+	deleteList(head);
+	head = nullptr;
+	count = 0;
+}
+
+} // DLNetwork
@@ -0,0 +1,213 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2019-2022 agdsdl <agdsdl@sina.com.cn>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <typeinfo>
+#include <functional>
+#include <type_traits>
+
+namespace DLNetwork {
+
+// 回调免堆分配的默认内联容量(字节)，可在编译选项中覆盖
+#ifndef SMALL_FUNCTION_INLINE_SIZE
+#define SMALL_FUNCTION_INLINE_SIZE 64
+#endif
+
+template<typename Signature, size_t InlineSize = SMALL_FUNCTION_INLINE_SIZE>
+class SmallFunction;
+
+/// 只可移动的std::function替代品
+/// 可调用对象不超过InlineSize字节(且可nothrow移动)时直接存放在对象内部，不做堆分配
+template<typename R, typename... Args, size_t InlineSize>
+class SmallFunction<R(Args...), InlineSize>
+{
+	static_assert(InlineSize >= sizeof(void*), "InlineSize too small");
+
+	struct Ops {
+		R (*invoke)(void* storage, Args&&... args);
+		void (*move)(void* dst, void* src) noexcept; // 移动构造到dst并析构src
+		void (*destroy)(void* storage) noexcept;
+		const std::type_info& (*type)() noexcept;
+	};
+
+	template<typename F>
+	struct fitsInline : std::integral_constant<bool,
+		sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value> {};
+
+	template<typename F>
+	struct InlineOps {
+		static F* get(void* s) { return std::launder(reinterpret_cast<F*>(s)); }
+		static R invoke(void* s, Args&&... args) {
+			// 同std::function，R为void时丢弃可调用对象的返回值
+			if constexpr (std::is_void_v<R>) {
+				std::invoke(*get(s), std::forward<Args>(args)...);
+			}
+			else {
+				return std::invoke(*get(s), std::forward<Args>(args)...);
+			}
+		}
+		static void move(void* dst, void* src) noexcept {
+			::new (dst) F(std::move(*get(src)));
+			get(src)->~F();
+		}
+		static void destroy(void* s) noexcept { get(s)->~F(); }
+		static const std::type_info& type() noexcept { return typeid(F); }
+		static constexpr Ops ops{ &invoke, &move, &destroy, &type };
+	};
+
+	template<typename F>
+	struct HeapOps {
+		static F*& get(void* s) { return *std::launder(reinterpret_cast<F**>(s)); }
+		static R invoke(void* s, Args&&... args) {
+			if constexpr (std::is_void_v<R>) {
+				std::invoke(*get(s), std::forward<Args>(args)...);
+			}
+			else {
+				return std::invoke(*get(s), std::forward<Args>(args)...);
+			}
+		}
+		static void move(void* dst, void* src) noexcept {
+			::new (dst) F*(get(src));
+			get(src) = nullptr;
+		}
+		static void destroy(void* s) noexcept { delete get(s); }
+		static const std::type_info& type() noexcept { return typeid(F); }
+		static constexpr Ops ops{ &invoke, &move, &destroy, &type };
+	};
+
+	template<typename T>
+	static bool isEmpty(const T&) { return false; }
+	template<typename T>
+	static bool isEmpty(T* p) { return p == nullptr; }
+	template<typename S>
+	static bool isEmpty(const std::function<S>& f) { return !f; }
+
+public:
+	static constexpr size_t inlineSize = InlineSize;
+
+	SmallFunction() noexcept {}
+	SmallFunction(std::nullptr_t) noexcept {}
+
+	template<typename F, typename D = std::decay_t<F>,
+		typename = std::enable_if_t<!std::is_same<D, SmallFunction>::value && std::is_invocable_r<R, D&, Args...>::value>>
+	SmallFunction(F&& f) {
+		if (isEmpty(f)) {
+			return;
+		}
+		if constexpr (fitsInline<D>::value) {
+			::new (static_cast<void*>(_storage)) D(std::forward<F>(f));
+			_ops = &InlineOps<D>::ops;
+		}
+		else {
+			::new (static_cast<void*>(_storage)) D*(new D(std::forward<F>(f)));
+			_ops = &HeapOps<D>::ops;
+		}
+	}
+
+	SmallFunction(SmallFunction&& other) noexcept {
+		moveFrom(other);
+	}
+
+	SmallFunction& operator=(SmallFunction&& other) noexcept {
+		if (this != &other) {
+			reset();
+			moveFrom(other);
+		}
+		return *this;
+	}
+
+	SmallFunction& operator=(std::nullptr_t) noexcept {
+		reset();
+		return *this;
+	}
+
+	template<typename F, typename D = std::decay_t<F>,
+		typename = std::enable_if_t<!std::is_same<D, SmallFunction>::value && std::is_invocable_r<R, D&, Args...>::value>>
+	SmallFunction& operator=(F&& f) {
+		SmallFunction tmp(std::forward<F>(f));
+		return *this = std::move(tmp);
+	}
+
+	SmallFunction(const SmallFunction&) = delete;
+	SmallFunction& operator=(const SmallFunction&) = delete;
+
+	~SmallFunction() {
+		reset();
+	}
+
+	explicit operator bool() const noexcept {
+		return _ops != nullptr;
+	}
+
+	R operator()(Args... args) const {
+		if (!_ops) {
+			throw std::bad_function_call();
+		}
+		return _ops->invoke(const_cast<unsigned char*>(_storage), std::forward<Args>(args)...);
+	}
+
+	const std::type_info& target_type() const noexcept {
+		return _ops ? _ops->type() : typeid(void);
+	}
+
+	// 类型F能否免堆分配存放
+	template<typename F>
+	static constexpr bool storedInline() {
+		return fitsInline<std::decay_t<F>>::value;
+	}
+
+private:
+	void reset() noexcept {
+		if (_ops) {
+			_ops->destroy(_storage);
+			_ops = nullptr;
+		}
+	}
+
+	void moveFrom(SmallFunction& other) noexcept {
+		if (other._ops) {
+			other._ops->move(_storage, other._storage);
+			_ops = other._ops;
+			other._ops = nullptr;
+		}
+	}
+
+	alignas(std::max_align_t) unsigned char _storage[InlineSize];
+	const Ops* _ops = nullptr;
+};
+
+template<typename R, typename... Args, size_t N>
+bool operator==(const SmallFunction<R(Args...), N>& f, std::nullptr_t) noexcept {
+	return !f;
+}
+
+template<typename R, typename... Args, size_t N>
+bool operator!=(const SmallFunction<R(Args...), N>& f, std::nullptr_t) noexcept {
+	return static_cast<bool>(f);
+}
+
+} // DLNetwork
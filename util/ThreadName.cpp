@@ -69,6 +69,25 @@ void DLNetwork::setThreadName(std::thread* thread, const char* threadName)
     ::setThreadName(threadId, threadName);
 }
 
+bool DLNetwork::setThreadAffinity(std::thread* thread, int cpu)
+{
+    return SetThreadAffinityMask(static_cast<HANDLE>(thread->native_handle()), DWORD_PTR(1) << cpu) != 0;
+}
+
+bool DLNetwork::setThreadAffinity(int cpu)
+{
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+}
+
+bool DLNetwork::setThreadAffinity(std::thread* thread, const std::vector<int>& cpus)
+{
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        mask |= DWORD_PTR(1) << cpu;
+    }
+    return SetThreadAffinityMask(static_cast<HANDLE>(thread->native_handle()), mask) != 0;
+}
+
 #elif defined(__linux__)
 #include <sys/prctl.h>
 #include <pthread.h>
@@ -83,6 +102,31 @@ void DLNetwork::setThreadName(std::thread* thread, const char* threadName)
     auto handle = thread->native_handle();
     pthread_setname_np(handle, threadName);
 }
+
+static bool setAffinity(pthread_t handle, const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        CPU_SET(cpu, &set);
+    }
+    return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+}
+
+bool DLNetwork::setThreadAffinity(std::thread* thread, int cpu)
+{
+    return setAffinity(thread->native_handle(), std::vector<int>{ cpu });
+}
+
+bool DLNetwork::setThreadAffinity(int cpu)
+{
+    return setAffinity(pthread_self(), std::vector<int>{ cpu });
+}
+
+bool DLNetwork::setThreadAffinity(std::thread* thread, const std::vector<int>& cpus)
+{
+    return setAffinity(thread->native_handle(), cpus);
+}
 #elif defined(__APPLE__)
 #include <pthread.h>
 
@@ -95,4 +139,19 @@ void DLNetwork::setThreadName(std::thread* thread, const char* threadName)
 {
 }
 
+bool DLNetwork::setThreadAffinity(std::thread* thread, int cpu)
+{
+    return false;
+}
+
+bool DLNetwork::setThreadAffinity(int cpu)
+{
+    return false;
+}
+
+bool DLNetwork::setThreadAffinity(std::thread* thread, const std::vector<int>& cpus)
+{
+    return false;
+}
+
 #endif
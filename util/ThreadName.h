@@ -23,8 +23,13 @@
  */
 #pragma once
 #include <thread>
+#include <vector>
 
 namespace DLNetwork {
 void setThreadName(std::thread* thread, const char* threadName);
 void setThreadName(const char* threadName);
+// 绑定线程到指定CPU，不支持的平台返回false
+bool setThreadAffinity(std::thread* thread, int cpu);
+bool setThreadAffinity(int cpu);
+bool setThreadAffinity(std::thread* thread, const std::vector<int>& cpus);
 } // DLNetwork
\ No newline at end of file
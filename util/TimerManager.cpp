@@ -22,5 +22,363 @@
  * SOFTWARE.
  */
 #include "TimerManager.h"
+#include <string.h>
 
 using namespace DLNetwork;
+
+TimerManager::TimerManager() {
+    memset(_tv1, 0, sizeof(_tv1));
+    memset(_tvn, 0, sizeof(_tvn));
+    _current = getCurrentMillisecs();
+}
+
+TimerManager::~TimerManager() {
+    auto freeList = [](Timer* t) {
+        while (t) {
+            Timer* next = t->_next;
+            delete t;
+            t = next;
+        }
+    };
+    for (int i = 0; i < TVR_SIZE; i++) {
+        freeList(_tv1[i]);
+    }
+    for (int l = 0; l < TVN_LEVELS; l++) {
+        for (int i = 0; i < TVN_SIZE; i++) {
+            freeList(_tvn[l][i]);
+        }
+    }
+    for (auto& item : _preciseTimers) {
+        delete item.second;
+    }
+    freeList(_freeList);
+}
+
+TimerId TimerManager::addTimer(unsigned int timeout, Timer::TIMER_FUN fun, void* args) {
+    Timer* timer = allocTimer(getCurrentMillisecs() + timeout, std::move(fun), args);
+    link(timer);
+    return TimerId(timer);
+}
+
+bool TimerManager::addIdle(Timer* timer) {
+    if (timer->_state != Timer::State::Idle) {
+        return false;
+    }
+    if (timer->cancelled()) {
+        // 加入前已被delTimer
+        release(timer);
+        return false;
+    }
+    return true;
+}
+
+void TimerManager::addTimer(Timer* timer) {
+    if (!addIdle(timer)) {
+        return;
+    }
+    link(timer);
+}
+
+void TimerManager::addTimer(Timer* timer, unsigned int timeout) {
+    if (!addIdle(timer)) {
+        return;
+    }
+    timer->_precise = false;
+    timer->expire = getCurrentMillisecs() + timeout;
+    link(timer);
+}
+
+TimerId TimerManager::addTimer(std::chrono::microseconds timeout, Timer::TIMER_FUN fun, void* args) {
+    Timer* timer = allocTimer(getCurrentMicrosecs() + timeout.count(), std::move(fun), args);
+    timer->_precise = true;
+    link(timer);
+    return TimerId(timer);
+}
+
+void TimerManager::addTimer(Timer* timer, std::chrono::microseconds timeout) {
+    if (!addIdle(timer)) {
+        return;
+    }
+    timer->_precise = true;
+    timer->expire = getCurrentMicrosecs() + timeout.count();
+    link(timer);
+}
+
+bool TimerManager::delTimer(TimerId id) {
+    if (!alive(id)) {
+        return false;
+    }
+    Timer* timer = id.timer;
+    switch (timer->_state) {
+    case Timer::State::Idle:
+        timer->cancel(id.seq);
+        return true;
+    case Timer::State::Pending:
+        unlink(timer);
+        release(timer);
+        return true;
+    case Timer::State::Running:
+        // 回调里删除自身，等回调返回后再回收
+        timer->_state = Timer::State::Cancelled;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TimerManager::resetTimer(TimerId id, unsigned int timeout) {
+    if (!alive(id)) {
+        return false;
+    }
+    Timer* timer = id.timer;
+    switch (timer->_state) {
+    case Timer::State::Pending:
+        unlink(timer);
+        // fallthrough
+    case Timer::State::Running:
+        timer->_precise = false;
+        timer->expire = getCurrentMillisecs() + timeout;
+        link(timer);
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool TimerManager::resetTimer(TimerId id, std::chrono::microseconds timeout) {
+    if (!alive(id)) {
+        return false;
+    }
+    Timer* timer = id.timer;
+    switch (timer->_state) {
+    case Timer::State::Pending:
+        unlink(timer);
+        // fallthrough
+    case Timer::State::Running:
+        timer->_precise = true;
+        timer->expire = getCurrentMicrosecs() + timeout.count();
+        link(timer);
+        return true;
+    default:
+        return false;
+    }
+}
+
+static unsigned long long mergeTimeout(unsigned long long wheelMs, unsigned long long preciseExpire, unsigned long long nowUs) {
+    if (preciseExpire == 0) {
+        return wheelMs;
+    }
+    // 向上取整，保证poll等只有毫秒精度的等待不会提前返回
+    unsigned long long ms = preciseExpire > nowUs ? (preciseExpire - nowUs + 999) / 1000 : 1;
+    return wheelMs == 0 || ms < wheelMs ? ms : wheelMs;
+}
+
+unsigned long long TimerManager::getRecentTimeout() {
+    if (size() == 0) {
+        return -1;
+    }
+    unsigned long long next = _count ? nextTimeout(getCurrentMillisecs()) : 0;
+    return mergeTimeout(next, nextPreciseExpire(), getCurrentMicrosecs());
+}
+
+unsigned long long TimerManager::processAllTimeout() {
+    runPreciseTimers();
+    unsigned long long next = processWheel(getCurrentMillisecs());
+    return mergeTimeout(next, nextPreciseExpire(), getCurrentMicrosecs());
+}
+
+void TimerManager::runPreciseTimers() {
+    if (_preciseTimers.empty()) {
+        return;
+    }
+    unsigned long long now = getCurrentMicrosecs();
+    while (!_preciseTimers.empty() && _preciseTimers.begin()->first <= now) {
+        Timer* timer = _preciseTimers.begin()->second;
+        unlink(timer);
+        timer->_state = Timer::State::Running;
+        int to = invoke(timer);
+        if (timer->_state == Timer::State::Pending) {
+            continue;
+        }
+        if (to > 0 && timer->_state == Timer::State::Running) {
+            timer->expire = now + to;
+            link(timer);
+        }
+        else {
+            release(timer);
+        }
+    }
+}
+
+unsigned long long TimerManager::processWheel(unsigned long long now) {
+    if (_count == 0) {
+        _current = now + 1;
+        return 0;
+    }
+
+    while (_current <= now) {
+        int index = _current & TVR_MASK;
+        if (index == 0) {
+            // 第一层转完一圈，把上层对应槽位的timer重新分散到下层
+            for (int level = 0; level < TVN_LEVELS; level++) {
+                int idx = (_current >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK;
+                if (cascade(level, idx) != 0) {
+                    break;
+                }
+            }
+        }
+        // 先推进_current，回调中新加的已到期timer会落到下一个槽位，不会在本槽内死循环
+        _current++;
+        while (Timer* timer = _tv1[index]) {
+            unlink(timer);
+            runTimer(timer, now);
+        }
+        if (_count == 0) {
+            _current = now + 1;
+            return 0;
+        }
+    }
+    return nextTimeout(now);
+}
+
+void TimerManager::link(Timer* timer) {
+    if (timer->_precise) {
+        _preciseTimers.emplace(timer->expire, timer);
+        timer->_state = Timer::State::Pending;
+        return;
+    }
+    unsigned long long expires = timer->expire;
+    long long delta = (long long)(expires - _current);
+    Timer** slot;
+    if (delta < 0) {
+        // 已经过期的，放到下一个要处理的槽位
+        slot = &_tv1[_current & TVR_MASK];
+    }
+    else if (delta < TVR_SIZE) {
+        slot = &_tv1[expires & TVR_MASK];
+    }
+    else {
+        if (delta > 0xffffffffLL) {
+            // 超出时间轮范围，先挂在最远处，到时runTimer会重新挂入
+            delta = 0xffffffffLL;
+            expires = _current + delta;
+        }
+        int level = 0;
+        while (level < TVN_LEVELS - 1 && delta >= (1LL << (TVR_BITS + (level + 1) * TVN_BITS))) {
+            level++;
+        }
+        slot = &_tvn[level][(expires >> (TVR_BITS + level * TVN_BITS)) & TVN_MASK];
+    }
+
+    timer->_slot = slot;
+    timer->_prev = nullptr;
+    timer->_next = *slot;
+    if (*slot) {
+        (*slot)->_prev = timer;
+    }
+    *slot = timer;
+    timer->_state = Timer::State::Pending;
+    _count++;
+}
+
+void TimerManager::unlink(Timer* timer) {
+    if (timer->_precise) {
+        _preciseTimers.erase(std::make_pair(timer->expire, timer));
+        timer->_state = Timer::State::Idle;
+        return;
+    }
+    if (timer->_prev) {
+        timer->_prev->_next = timer->_next;
+    }
+    else {
+        *timer->_slot = timer->_next;
+    }
+    if (timer->_next) {
+        timer->_next->_prev = timer->_prev;
+    }
+    timer->_prev = nullptr;
+    timer->_next = nullptr;
+    timer->_slot = nullptr;
+    timer->_state = Timer::State::Idle;
+    _count--;
+}
+
+int TimerManager::cascade(int level, int index) {
+    Timer* list = _tvn[level][index];
+    _tvn[level][index] = nullptr;
+    while (list) {
+        Timer* timer = list;
+        list = timer->_next;
+        timer->_prev = nullptr;
+        timer->_next = nullptr;
+        _count--;
+        link(timer);
+    }
+    return index;
+}
+
+void TimerManager::runTimer(Timer* timer, unsigned long long now) {
+    if (timer->expire > now) {
+        // 超出时间轮范围被提前挂入的
+        link(timer);
+        return;
+    }
+    timer->_state = Timer::State::Running;
+    int to = invoke(timer);
+    if (timer->_state == Timer::State::Pending) {
+        // 回调中resetTimer了自己
+        return;
+    }
+    if (to > 0 && timer->_state == Timer::State::Running) {
+        timer->expire = now + to;
+        link(timer);
+    }
+    else {
+        release(timer);
+    }
+}
+
+int TimerManager::invoke(Timer* timer) {
+    if (!_runHook) {
+        return timer->active();
+    }
+    unsigned long long start = getCurrentMicrosecs();
+    unsigned long long due = timer->_precise ? timer->expire : timer->expire * 1000;
+    int to = timer->active();
+    _runHook(timer, start > due ? start - due : 0, getCurrentMicrosecs() - start);
+    return to;
+}
+
+Timer* TimerManager::allocTimer(unsigned long long expire, Timer::TIMER_FUN&& fun, void* args) {
+    if (_freeList) {
+        Timer* timer = _freeList;
+        _freeList = timer->_next;
+        timer->_next = nullptr;
+        timer->rebind(std::move(fun), args);
+        timer->expire = expire;
+        timer->_state = Timer::State::Idle;
+        timer->_precise = false;
+        return timer;
+    }
+    return new Timer(expire, std::move(fun), args);
+}
+
+void TimerManager::release(Timer* timer) {
+    // 立即释放回调捕获的资源，Timer对象本身留待复用
+    timer->_fun = nullptr;
+    timer->_state = Timer::State::Free;
+    timer->_prev = nullptr;
+    timer->_slot = nullptr;
+    timer->_next = _freeList;
+    _freeList = timer;
+}
+
+unsigned long long TimerManager::nextTimeout(unsigned long long now) {
+    // 只扫描第一层到本圈结束，第一层没有时返回到下次cascade的时间
+    // _current正好在圈边界时上层还没cascade下来，不能越过
+    unsigned long long tick = _current;
+    while ((tick & TVR_MASK) && !_tv1[tick & TVR_MASK]) {
+        tick++;
+    }
+    return tick > now ? tick - now : 1;
+}
@@ -24,12 +24,18 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <iostream>
 #include <algorithm>
 #include <queue>
 #include <vector>
+#include <set>
 #include <chrono>
+#include <atomic>
+#include <typeinfo>
+#include <cstdint>
 #include "platform.h"
+#include "SmallFunction.h"
 
 namespace DLNetwork {
 
@@ -101,120 +107,169 @@ protected:
     std::shared_ptr<func_type> _strongTask;
 };
 
-class Timer : public TaskCancelable<int, void*>
+class Timer : public noncopyable
 {
 public:
     friend class TimerManager;
-    using TIMER_FUN = std::function<int(void*)>; // return next trigger timeout in ms. return 0 means don't trigger again.
+    using TIMER_FUN = SmallFunction<int(void*)>; // return next trigger timeout in ms(高精度timer为us). return 0 means don't trigger again.
 
     Timer(unsigned long long expire, TIMER_FUN fun, void* args)
-        : TaskCancelable<int, void*>(std::move(fun)), expire(expire), args(args) {
+        : _fun(std::move(fun)), args(args), expire(expire), _seq(nextSeq()) {
     }
 
-    inline int active() { return (*this)(args); }
+    inline int active() {
+        if (_cancelledSeq.load(std::memory_order_acquire) == _seq || !_fun) {
+            return 0;
+        }
+        return _fun(args);
+    }
+    // 可在任意线程调用，seq与当前绑定的不符(Timer已被回收复用)时什么都不做
+    // 只增不减，过期的cancel不会覆盖新主人的cancel
+    void cancel(uint64_t seq) {
+        uint64_t cur = _cancelledSeq.load(std::memory_order_relaxed);
+        while (cur < seq && !_cancelledSeq.compare_exchange_weak(cur, seq, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
 
     inline unsigned long long getExpire() const { return expire; }
+    // 高精度timer的expire单位为us
+    inline bool isPrecise() const { return _precise; }
+    // 每次绑定新回调时分配的序号，全局递增
+    inline uint64_t seq() const { return _seq; }
+    // 回调的类型，用于统计时定位慢回调
+    const std::type_info& targetType() const { return _fun.target_type(); }
 
 protected:
-    TIMER_FUN fun;
+    enum class State : uint8_t {
+        Idle,       // 尚未加入TimerManager
+        Pending,    // 挂在时间轮上
+        Running,    // 回调执行中
+        Cancelled,  // 回调执行中被delTimer，回调返回后回收
+        Free,       // 已回收到空闲链表，等待复用
+    };
+
+    static uint64_t nextSeq() {
+        static std::atomic<uint64_t> seq{ 0 };
+        return seq.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void rebind(TIMER_FUN&& f, void* a) {
+        _fun = std::move(f);
+        args = a;
+        _seq = nextSeq();
+    }
+
+    bool cancelled() const { return _cancelledSeq.load(std::memory_order_acquire) == _seq; }
+
+    TIMER_FUN _fun;
     void* args;
 
     unsigned long long expire;
+
+    // 时间轮槽位内的双向链表
+    Timer* _prev = nullptr;
+    Timer* _next = nullptr;
+    Timer** _slot = nullptr;
+    State _state = State::Idle;
+    bool _precise = false;
+    uint64_t _seq;
+    std::atomic<uint64_t> _cancelledSeq{ 0 };
 };
 
+/// addTimer返回的句柄，带上分配时的序号
+/// Timer到期或删除后会被回收复用，旧句柄的序号对不上，delTimer/resetTimer直接返回false，不会误伤新的timer
+struct TimerId {
+    Timer* timer = nullptr;
+    uint64_t seq = 0;
+
+    TimerId() {}
+    explicit TimerId(Timer* t) : timer(t), seq(t ? t->seq() : 0) {}
+    explicit operator bool() const { return timer != nullptr; }
+    bool operator==(const TimerId& o) const { return timer == o.timer && seq == o.seq; }
+    bool operator!=(const TimerId& o) const { return !(*this == o); }
+};
 
+/// 分层时间轮(同Linux经典timer wheel)，精度1ms
+/// 第一层256个槽，之后4层各64个槽，覆盖2^32ms；插入、删除、重置都是O(1)
+/// 到期或删除的Timer回收到空闲链表复用，直到TimerManager析构才释放
+/// 对外只暴露带序号的TimerId，已触发的一次性timer即使Timer对象已被复用，delTimer/resetTimer也只会返回false
+/// 微秒级的高精度timer不进时间轮，单独按到期时间排序，由EventThread用timerfd唤醒
 class TimerManager
 {
 public:
-    TimerManager() {}
-
-    Timer* addTimer(unsigned int timeout, Timer::TIMER_FUN fun, void* args = NULL) {
-        unsigned long long now = getCurrentMillisecs();
-        Timer* timer = new Timer(now + timeout, fun, args);
-        _queue.push(timer);
-
-        return timer;
+    TimerManager();
+    ~TimerManager();
+    TimerManager(const TimerManager&) = delete;
+    TimerManager& operator=(const TimerManager&) = delete;
+
+    TimerId addTimer(unsigned int timeout, Timer::TIMER_FUN fun, void* args = NULL);
+    // 加入外部new出来的Timer，之后由TimerManager回收。timer->getExpire()为绝对时间(ms)
+    void addTimer(Timer* timer);
+    void addTimer(Timer* timer, unsigned int timeout);
+    // 还没加入的timer(跨线程addTimer的任务未执行)先标记取消，加入时直接回收
+    bool delTimer(TimerId id);
+    // 把仍在等待的timer改为timeout毫秒后触发，timer已触发或已删除时返回false
+    bool resetTimer(TimerId id, unsigned int timeout);
+
+    // 高精度timer，回调返回值也是us
+    TimerId addTimer(std::chrono::microseconds timeout, Timer::TIMER_FUN fun, void* args = NULL);
+    void addTimer(Timer* timer, std::chrono::microseconds timeout);
+    bool resetTimer(TimerId id, std::chrono::microseconds timeout);
+    // 最近一个高精度timer的到期时间(steady_clock, us)，没有时返回0
+    unsigned long long nextPreciseExpire() const {
+        return _preciseTimers.empty() ? 0 : _preciseTimers.begin()->first;
     }
 
-    void addTimer(Timer* timer) {
-        _queue.push(timer);
-    }
+    unsigned long long getRecentTimeout();
+    // 执行所有到期的timer，返回距下次需要处理的毫秒数，没有timer时返回0
+    unsigned long long processAllTimeout();
 
-    bool delTimer(Timer* timer) {
-        std::priority_queue<Timer*, std::vector<Timer*>, cmp> newqueue;
+    size_t size() const { return _count + _preciseTimers.size(); }
 
-        bool found = false;
-        while (!_queue.empty()) {
-            Timer* top = _queue.top();
-            _queue.pop();
-            if (top != timer) {
-                newqueue.push(top);
-            }
-            else {
-                found = true;
-            }
-        }
-        _queue = newqueue;
-        if (found) {
-            delete timer;
-        }
-        return found;
-    }
-
-    unsigned long long getRecentTimeout() {
-        unsigned long long timeout = -1;
-        if (_queue.empty())
-            return timeout;
-
-        unsigned long long now = getCurrentMillisecs();
-        timeout = _queue.top()->getExpire() - now;
-        if (timeout < 0)
-            timeout = 0;
-
-        return timeout;
-    }
-
-    unsigned long long  processAllTimeout() {
-        unsigned long long now = getCurrentMillisecs();
-
-        while (!_queue.empty()) {
-            Timer* timer = _queue.top();
-            if (timer->getExpire() <= now) {
-                _queue.pop();
-                int to = timer->active();
-                if (to > 0) {
-                    timer->expire = now + to;
-                    _queue.push(timer);
-                }
-                else {
-                    delete timer;
-                }
-            }
-            else {
-                return timer->getExpire() - now;
-            }
-        }
-        return 0;
-    }
+    // 每个timer回调返回后调用，lateUs为开始执行时已超过到期时间多少，costUs为回调耗时
+    // 未设置时不额外读时钟
+    using RunHook = std::function<void(Timer*, unsigned long long lateUs, unsigned long long costUs)>;
+    void setRunHook(RunHook hook) { _runHook = std::move(hook); }
 
     unsigned long long getCurrentMillisecs() {
-#if !defined(_WIN32)
-        struct timeval tv;
-        gettimeofday(&tv, NULL);
-        return tv.tv_sec * 1000LL + tv.tv_usec / 1000;
-#else
-        return  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-#endif
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    unsigned long long getCurrentMicrosecs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
     }
 
 private:
-
-    struct cmp
-    {
-        bool operator()(Timer*& lhs, Timer*& rhs) const { return lhs->getExpire() > rhs->getExpire(); }
-    };
-
-    std::priority_queue<Timer*, std::vector<Timer*>, cmp> _queue;
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;
+    static const int TVN_SIZE = 1 << TVN_BITS;
+    static const int TVR_MASK = TVR_SIZE - 1;
+    static const int TVN_MASK = TVN_SIZE - 1;
+    static const int TVN_LEVELS = 4;
+
+    // 句柄仍指向最初分配的那次绑定
+    static bool alive(const TimerId& id) {
+        return id.timer && id.timer->_seq == id.seq && id.timer->_state != Timer::State::Free;
+    }
+    bool addIdle(Timer* timer);
+    void link(Timer* timer);
+    void unlink(Timer* timer);
+    int cascade(int level, int index);
+    void runTimer(Timer* timer, unsigned long long now);
+    void runPreciseTimers();
+    int invoke(Timer* timer);
+    unsigned long long processWheel(unsigned long long now);
+    Timer* allocTimer(unsigned long long expire, Timer::TIMER_FUN&& fun, void* args);
+    void release(Timer* timer);
+    unsigned long long nextTimeout(unsigned long long now);
+
+    Timer* _tv1[TVR_SIZE];
+    Timer* _tvn[TVN_LEVELS][TVN_SIZE];
+    unsigned long long _current; // 下一个待处理的tick
+    size_t _count = 0; // 时间轮上的timer数
+    Timer* _freeList = nullptr;
+    std::set<std::pair<unsigned long long, Timer*>> _preciseTimers;
+    RunHook _runHook;
 };
 
 } //DLNetwork
\ No newline at end of file